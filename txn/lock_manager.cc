@@ -48,6 +48,11 @@ bool LockManagerA::ReadLock(Txn* txn, const Key& key) {
   return WriteLock(txn, key);
 }
 
+bool LockManagerA::IncrementLock(Txn* txn, const Key& key) {
+  // Likewise, increments take exclusive locks.
+  return WriteLock(txn, key);
+}
+
 void LockManagerA::Release(Txn* txn, const Key& key) {
   unordered_map<Key, deque<LockRequest>*>::iterator lock_deq =
     lock_table_.find(key);
@@ -157,12 +162,20 @@ bool LockManagerB::WriteLock(Txn* txn, const Key& key) {
 }
 
 bool LockManagerB::ReadLock(Txn* txn, const Key& key) {
+  return SharedLock(txn, key, SHARED);
+}
+
+bool LockManagerB::IncrementLock(Txn* txn, const Key& key) {
+  return SharedLock(txn, key, INCREMENT);
+}
+
+bool LockManagerB::SharedLock(Txn* txn, const Key& key, LockMode mode) {
   unordered_map<Key, deque<LockRequest>*>::iterator lock_deq =
     lock_table_.find(key);
   if (lock_deq == lock_table_.end()) {  // if not found
     deque<LockRequest> *deq_insert =
       new deque<LockRequest>();  // make new deque
-    LockRequest *tr = new LockRequest(SHARED, txn);
+    LockRequest *tr = new LockRequest(mode, txn);
     deq_insert->push_back(*tr);  // add LockRequest Object to deque
     // add deque to hash and notify system that txn is alive
     lock_table_.insert(pair<Key, deque<LockRequest>*>(key, deq_insert));
@@ -170,7 +183,7 @@ bool LockManagerB::ReadLock(Txn* txn, const Key& key) {
     return true;  // instant lock
   } else {  // if deque found, add Lock Request regardless of content
     deque<LockRequest> *d = lock_deq->second;
-    d->push_back(LockRequest(SHARED, txn));
+    d->push_back(LockRequest(mode, txn));
     // signal instant lock access if deque is empty
     if (d->size() == 1) {
       // Notify system that the txn is alive
@@ -179,15 +192,15 @@ bool LockManagerB::ReadLock(Txn* txn, const Key& key) {
     } else {  // signal no lock yet granted if deque not empty
       for (deque<LockRequest>::iterator share_check = lock_deq->second->begin();
           share_check != lock_deq->second->end() &&
-             share_check->mode_ != EXCLUSIVE;
+             share_check->mode_ == mode;
           ++share_check) {
-        if (share_check->txn_ == txn) {  // Only shared locks held on key so far
+        if (share_check->txn_ == txn) {  // Only 'mode' locks held on key so far
           unordered_map<Txn*, int>::iterator found = txn_waits_.find(txn);
           if (found == txn_waits_.end()) {  // This txn does not exist yet
             txn_waits_.insert(pair<Txn*, int>(txn, 0));  // Notify system not a
                                                         // zombie
           }  // else no need to do anything
-          return true;  // can grant shared read lock right away
+          return true;  // can grant shared lock right away
         }
       }
 
@@ -235,116 +248,62 @@ void LockManagerB::Release(Txn* txn, const Key& key) {
       // Remove the txn entry from the lock table
       deque<LockRequest>::iterator next = lock_deq->second->erase(l);
 
-      // Check to see which txn to set ready next
-      while (next != lock_deq->second->end()) {  // While there are txns
-        // If txn was an exclusive txn, then check the next txn, and grant locks
-        // until another exclusive lock request. Else if the lock was the last
-        // shared, then grant the immediate next one (unless its a
-        // zombie). Otherwise don't do anything because it's been taken care of
-        // elsewhere.
-        if (txn_mode == EXCLUSIVE) {  // Grant the following txns
-          unordered_map<Txn*, int>::iterator unlock =
-            txn_waits_.find(next->txn_);
-          if (unlock == txn_waits_.end()) {  // Found a zombie
-            next = lock_deq->second->erase(next);  // Update iterator
-            continue;
-          } else {  // Grant the lock to the txn
-            --(unlock->second);  // Reduce the lock_wait count
-            if (unlock->second == 0) {  // All locks granted
-              ready_txns_->push_back(next->txn_);  // State txn as ready
-            }  // else continue
-          }
-          if (next->mode_ == EXCLUSIVE) {  // Exclusive txn so break
-            break;
-          } else {  // Increment and check for exclusive
-            ++next;
-            if (next != lock_deq->second->end() &&
-                next->mode_ == EXCLUSIVE)
-              break;
-          }
-        } else {  // txn_mode == SHARED. This transaction was a shared
-          if (next->mode_ == SHARED) {  // Deal with edge case of zombie X lock
-            unordered_map<Txn*, int>::iterator unlock =
-              txn_waits_.find(next->txn_);
-            if (unlock->second == 0) {  // Probably already has a lock. So break
-              break;
-            } else {
-              --(unlock->second);  // Mark as locked
-              if (unlock->second == 0) {  // Send to ready
-                ready_txns_->push_back(next->txn_);
-              }
-
-              // Increment next and check for more locks
-              ++next;
-              if (next != lock_deq->second->end() &&
-                  next->mode_ == EXCLUSIVE)
-                break;
-            }
-          } else {  // Check for zombie, else send to ready and break
-            unordered_map<Txn*, int>::iterator found =
-              txn_waits_.find(next->txn_);
-            if (found == txn_waits_.end()) {  // found a zombie
-              next = lock_deq->second->erase(next);  // Update next
-              continue;
-            } else {  // This is valid transaction and hence break
-              --(found->second);  // Mark as locked
-              if (found->second == 0) {  // Send to ready
-                ready_txns_->push_back(next->txn_);
-              }
-              break;
-            }
-          }
+      // Grant the lock to the requests now at the head of the deque: the
+      // next EXCLUSIVE request, or the run of SHARED (or INCREMENT) requests
+      // that follows. Nothing changes if the txn was sharing the lock with the
+      // next request. Zombies are dropped along the way.
+      bool granting = (txn_mode == EXCLUSIVE ||
+                       next == lock_deq->second->end() ||
+                       next->mode_ != txn_mode);
+      LockMode group = UNLOCKED;  // Mode of the requests granted so far
+      while (granting && next != lock_deq->second->end()) {
+        if (group == EXCLUSIVE || (group != UNLOCKED && next->mode_ != group))
+          break;  // End of the group
+        unordered_map<Txn*, int>::iterator unlock =
+          txn_waits_.find(next->txn_);
+        if (unlock == txn_waits_.end()) {  // Found a zombie
+          next = lock_deq->second->erase(next);  // Update iterator
+          continue;
         }
+        --(unlock->second);  // Reduce the lock_wait count
+        if (unlock->second == 0) {  // All locks granted
+          ready_txns_->push_back(next->txn_);  // State txn as ready
+        }
+        group = next->mode_;
+        ++next;
       }
     } else {                               // Else middle of the deque
-      if (txn_mode == EXCLUSIVE) {   // Edge case of possible X btw. S
-        bool share_sandwich = true;  // Flag for S sandwich
-        for (deque<LockRequest>::iterator dummy = lock_deq->second->begin();
-             dummy != l; ++dummy) {  // Loop to check for valid S's
-          if (dummy->mode_ == EXCLUSIVE) {  // Sandwich impossible :(
-            share_sandwich = false;
-            break;
-          }
-        }
-        if (share_sandwich) {        // We have a sandwich. Oh Joy!
-          unordered_map<Txn*, int>::iterator zombie = txn_waits_.find(txn);
-          if (zombie != txn_waits_.end()) {  // System thinks txn is alive
-            txn_waits_.erase(txn);           //   Prove it wrong!
-          }                                  // Else do nothing to wait-list
+      unordered_map<Txn*, int>::iterator found = txn_waits_.find(txn);
+      if (found != txn_waits_.end()) {  // System thinks txn is alive
+        txn_waits_.erase(txn);          //   Prove it wrong!
+      }                                 // Else do nothing to wait-list
 
-          // Remove the txn from the deque
-          deque<LockRequest>::iterator next = lock_deq->second->erase(l);
-          while (next != lock_deq->second->end() && next->mode_ == SHARED) {
-            unordered_map<Txn*, int>::iterator found =
-              txn_waits_.find(next->txn_);
-            if (found == txn_waits_.end()) {  // Found a zombie
-              next = lock_deq->second->erase(next);  // Update next
-              continue;
-            } else {
-              --(found->second);  // Mark as locked
-              if (found->second == 0) {  // Send to ready
-                ready_txns_->push_back(next->txn_);
-              }
-              ++next;
-            }
-          }
-        } else {                     // No sandwich. So remove the stuff
-          unordered_map<Txn*, int>::iterator found = txn_waits_.find(txn);
-          if (found != txn_waits_.end()) {  // System thinks txn is alive
-            txn_waits_.erase(txn);          //   Prove it wrong!
-          }                                 // Else do nothing to wait-list
+      // If every request ahead of the txn shares the lock in a mode other
+      // than the txn's (e.g. an X between S's), the requests behind it in
+      // that mode are no longer blocked.
+      LockMode ahead = lock_deq->second->begin()->mode_;
+      bool sandwich = (ahead != EXCLUSIVE && txn_mode != ahead);
+      for (deque<LockRequest>::iterator dummy = lock_deq->second->begin();
+           sandwich && dummy != l; ++dummy) {
+        if (dummy->mode_ != ahead)
+          sandwich = false;
+      }
 
-          // Remove the txn entry from the lock table
-          lock_deq->second->erase(l);
+      // Remove the txn entry from the lock table
+      deque<LockRequest>::iterator next = lock_deq->second->erase(l);
+      while (sandwich && next != lock_deq->second->end() &&
+             next->mode_ == ahead) {
+        unordered_map<Txn*, int>::iterator waiting =
+          txn_waits_.find(next->txn_);
+        if (waiting == txn_waits_.end()) {  // Found a zombie
+          next = lock_deq->second->erase(next);  // Update next
+          continue;
         }
-      } else {  // txn_mode == SHARED. Just remove it
-        unordered_map<Txn*, int>::iterator found = txn_waits_.find(txn);
-        if (found != txn_waits_.end()) {  // System thinks txn is alive
-          txn_waits_.erase(txn);          //   Prove it wrong!
-        }                                 // Else do nothing to wait-list
-
-        // Remove the txn entry from the lock table
-        lock_deq->second->erase(l);
+        --(waiting->second);  // Mark as locked
+        if (waiting->second == 0) {  // Send to ready
+          ready_txns_->push_back(next->txn_);
+        }
+        ++next;
       }
     }                                      // end else (middle of deque)
     break;  // Do not continue with the loop. Transaction has been handled
@@ -356,28 +315,26 @@ void LockManagerB::Release(Txn* txn, const Key& key) {
 LockMode LockManagerB::Status(const Key& key, vector<Txn*>* owners) {
   unordered_map<Key, deque<LockRequest>*>::iterator lock_deq =
     lock_table_.find(key);
-  LockMode mode = EXCLUSIVE;
   owners->clear();  // clear old lock owners
   if (lock_deq == lock_table_.end()) {  // if not found
     return UNLOCKED;
-  } else {  // if deque found, find all Txn's and add to owners
-    deque<LockRequest>::iterator l =
-      lock_deq->second->begin();  // holds txn
-    if (l == lock_deq->second->end())
-      return UNLOCKED;
+  }
 
-    if (l->mode_ == EXCLUSIVE) {
-      owners->push_back(l->txn_);
-      return EXCLUSIVE;
-    }
+  // find all Txn's holding the lock and add to owners
+  deque<LockRequest>::iterator l =
+    lock_deq->second->begin();  // holds txn
+  if (l == lock_deq->second->end())
+    return UNLOCKED;
 
-    while (l != lock_deq->second->end() && l->mode_ != EXCLUSIVE) {
-      owners->push_back(l->txn_);
-      if (l->mode_ != mode) {
-        mode = SHARED;
-      }
-      ++l;
-    }
+  LockMode mode = l->mode_;
+  if (mode == EXCLUSIVE) {
+    owners->push_back(l->txn_);
+    return EXCLUSIVE;
+  }
+
+  while (l != lock_deq->second->end() && l->mode_ == mode) {
+    owners->push_back(l->txn_);
+    ++l;
   }
   return mode;
 }
@@ -22,12 +22,15 @@ using std::tr1::unordered_map;
 
 class Txn;
 
-// This interface supports locks being held in both read/shared and
-// write/exclusive modes.
+// This interface supports locks being held in read/shared, write/exclusive
+// and increment modes. Increment locks are shared among txns that only
+// increment the record (see 'Txn::Increment()'), since increments commute, but
+// conflict with read and write locks alike.
 enum LockMode {
   UNLOCKED = 0,
   SHARED = 1,
   EXCLUSIVE = 2,
+  INCREMENT = 3,
 };
 
 class LockManager {
@@ -50,6 +53,14 @@ class LockManager {
   //           this txn and key.
   virtual bool WriteLock(Txn* txn, const Key& key) = 0;
 
+  // Attempts to grant an increment lock to the specified transaction,
+  // enqueueing request in lock table. Returns true if lock is immediately
+  // granted, else returns false.
+  //
+  // Requires: None of ReadLock, WriteLock and IncrementLock has previously
+  //           been called with this txn and key.
+  virtual bool IncrementLock(Txn* txn, const Key& key) = 0;
+
   // Releases lock held by 'txn' on 'key', or cancels any pending request for
   // a lock on 'key' by 'txn'. If 'txn' held an EXCLUSIVE lock on 'key' (or was
   // the sole holder of a SHARED lock on 'key'), then the next request(s) in the
@@ -66,7 +77,8 @@ class LockManager {
 
   // Sets '*owners' to contain the txn IDs of all txns holding the lock, and
   // returns the current LockMode of the lock: UNLOCKED if it is not currently
-  // held, SHARED or EXCLUSIVE if it is, depending on the current state.
+  // held, SHARED, INCREMENT or EXCLUSIVE if it is, depending on the current
+  // state.
   virtual LockMode Status(const Key& key, vector<Txn*>* owners) = 0;
 
  protected:
@@ -77,8 +89,8 @@ class LockManager {
   //  (a) first element in the deque specifies the owner if that item is a
   //      request for an EXCLUSIVE lock, or
   //
-  //  (b) a SHARED lock is held by all elements of the longest prefix of the
-  //      deque containing only SHARED lock requests.
+  //  (b) a SHARED (or INCREMENT) lock is held by all elements of the longest
+  //      prefix of the deque containing only SHARED (INCREMENT) lock requests.
   //
   // For example, if lock_table_["key1"] points to a deque containing
   //
@@ -96,6 +108,8 @@ class LockManager {
   //
   // then Txn1 currently holds an EXCLUSIVE lock on "key1". When Txn1 releases
   // its lock, Txn2 and Txn3 will simultaneously acquire SHARED locks on "key1".
+  // INCREMENT requests are granted in groups the same way, but never together
+  // with SHARED ones.
   struct LockRequest {
     LockRequest(LockMode m, Txn* t) : txn_(t), mode_(m) {}
     Txn* txn_;       // Pointer to txn requesting the lock.
@@ -122,11 +136,13 @@ class LockManagerA : public LockManager {
 
   virtual bool ReadLock(Txn* txn, const Key& key);
   virtual bool WriteLock(Txn* txn, const Key& key);
+  virtual bool IncrementLock(Txn* txn, const Key& key);
   virtual void Release(Txn* txn, const Key& key);
   virtual LockMode Status(const Key& key, vector<Txn*>* owners);
 };
 
-// Version of the LockManager implementing both shared and exclusive locks.
+// Version of the LockManager implementing shared, increment and exclusive
+// locks.
 class LockManagerB : public LockManager {
  public:
   explicit LockManagerB(deque<Txn*>* ready_txns);
@@ -134,8 +150,14 @@ class LockManagerB : public LockManager {
 
   virtual bool ReadLock(Txn* txn, const Key& key);
   virtual bool WriteLock(Txn* txn, const Key& key);
+  virtual bool IncrementLock(Txn* txn, const Key& key);
   virtual void Release(Txn* txn, const Key& key);
   virtual LockMode Status(const Key& key, vector<Txn*>* owners);
+
+ private:
+  // Requests a lock in 'mode' (SHARED or INCREMENT), which is granted right
+  // away if all earlier requests for the key are in that same mode.
+  bool SharedLock(Txn* txn, const Key& key, LockMode mode);
 };
 
 #endif  // _LOCK_MANAGER_H_
@@ -186,10 +186,107 @@ TEST(LockManagerB_LocksReleasedOutOfOrder) {
   END;
 }
 
+TEST(LockManagerB_SharedReleaseDoesNotWakeWaiter) {
+  deque<Txn*> ready_txns;
+  LockManagerB lm(&ready_txns);
+  vector<Txn*> owners;
+
+  Txn* t1 = reinterpret_cast<Txn*>(1);
+  Txn* t2 = reinterpret_cast<Txn*>(2);
+  Txn* t3 = reinterpret_cast<Txn*>(3);
+
+  lm.WriteLock(t3, 102);  // Txn 3 acquires write lock on 102.
+  ready_txns.push_back(t3);  // Txn 3 is ready.
+  lm.ReadLock(t1, 101);   // Txn 1 acquires read lock on 101.
+  ready_txns.push_back(t1);  // Txn 1 is ready.
+  lm.ReadLock(t2, 101);   // Txn 2 shares read lock on 101...
+  lm.WriteLock(t2, 102);  // ...but still waits for write lock on 102.
+  EXPECT_EQ(2, ready_txns.size());
+
+  // Txn 1 releases its read lock. Txn 2 keeps its read lock on 101 but is
+  // still waiting for 102, so must not become ready.
+  lm.Release(t1, 101);
+  EXPECT_EQ(SHARED, lm.Status(101, &owners));
+  EXPECT_EQ(1, owners.size());
+  EXPECT_EQ(t2, owners[0]);
+  EXPECT_EQ(2, ready_txns.size());
+
+  // Txn 3 releases its write lock. Txn 2 now holds all its locks.
+  lm.Release(t3, 102);
+  EXPECT_EQ(EXCLUSIVE, lm.Status(102, &owners));
+  EXPECT_EQ(1, owners.size());
+  EXPECT_EQ(t2, owners[0]);
+  EXPECT_EQ(3, ready_txns.size());
+  EXPECT_EQ(t2, ready_txns.at(2));
+
+  END;
+}
+
+TEST(LockManagerB_IncrementLocksShared) {
+  deque<Txn*> ready_txns;
+  LockManagerB lm(&ready_txns);
+  vector<Txn*> owners;
+
+  Txn* t1 = reinterpret_cast<Txn*>(1);
+  Txn* t2 = reinterpret_cast<Txn*>(2);
+  Txn* t3 = reinterpret_cast<Txn*>(3);
+  Txn* t4 = reinterpret_cast<Txn*>(4);
+  Txn* t5 = reinterpret_cast<Txn*>(5);
+
+  // Txns 1 and 2 share an increment lock.
+  EXPECT_TRUE(lm.IncrementLock(t1, 101));
+  ready_txns.push_back(t1);
+  EXPECT_TRUE(lm.IncrementLock(t2, 101));
+  ready_txns.push_back(t2);
+  EXPECT_EQ(INCREMENT, lm.Status(101, &owners));
+  EXPECT_EQ(2, owners.size());
+  EXPECT_EQ(t1, owners[0]);
+  EXPECT_EQ(t2, owners[1]);
+
+  // Txn 3 requests read lock, Txn 4 increment lock, Txn 5 read lock. None is
+  // granted: the increments conflict with the reads, and Txn 4 is behind
+  // Txn 3.
+  EXPECT_FALSE(lm.ReadLock(t3, 101));
+  EXPECT_FALSE(lm.IncrementLock(t4, 101));
+  EXPECT_FALSE(lm.ReadLock(t5, 101));
+  EXPECT_EQ(INCREMENT, lm.Status(101, &owners));
+  EXPECT_EQ(2, owners.size());
+  EXPECT_EQ(2, ready_txns.size());
+
+  // Txn 1 releases lock. Txn 2 still holds its increment lock.
+  lm.Release(t1, 101);
+  EXPECT_EQ(INCREMENT, lm.Status(101, &owners));
+  EXPECT_EQ(1, owners.size());
+  EXPECT_EQ(t2, owners[0]);
+  EXPECT_EQ(2, ready_txns.size());
+
+  // Txn 2 releases lock. Txn 3 is granted read lock.
+  lm.Release(t2, 101);
+  EXPECT_EQ(SHARED, lm.Status(101, &owners));
+  EXPECT_EQ(1, owners.size());
+  EXPECT_EQ(t3, owners[0]);
+  EXPECT_EQ(3, ready_txns.size());
+  EXPECT_EQ(t3, ready_txns.at(2));
+
+  // Txn 4 cancels its increment lock request. Txn 5 now shares the read
+  // lock with Txn 3.
+  lm.Release(t4, 101);
+  EXPECT_EQ(SHARED, lm.Status(101, &owners));
+  EXPECT_EQ(2, owners.size());
+  EXPECT_EQ(t3, owners[0]);
+  EXPECT_EQ(t5, owners[1]);
+  EXPECT_EQ(4, ready_txns.size());
+  EXPECT_EQ(t5, ready_txns.at(3));
+
+  END;
+}
+
 int main(int argc, char** argv) {
   LockManagerA_SimpleLocking();
   LockManagerA_LocksReleasedOutOfOrder();
   LockManagerB_SimpleLocking();
   LockManagerB_LocksReleasedOutOfOrder();
+  LockManagerB_SharedReleaseDoesNotWakeWaiter();
+  LockManagerB_IncrementLocksShared();
 }
 
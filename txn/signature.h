@@ -0,0 +1,52 @@
+// Compact, fixed-size signatures of sets of keys.
+
+#ifndef _SIGNATURE_H_
+#define _SIGNATURE_H_
+
+#include "txn/common.h"
+
+// A Signature is a single-hash bloom filter over keys. Two signatures that
+// share no bits are guaranteed to have been built from disjoint key sets, while
+// overlapping signatures only PROBABLY come from intersecting sets. Building
+// and intersecting signatures never allocates memory.
+class Signature {
+ public:
+  // Signatures come into the world empty.
+  Signature() { Clear(); }
+
+  // Removes all keys from the signature.
+  void Clear() {
+    for (int i = 0; i < kWords; i++)
+      bits_[i] = 0;
+  }
+
+  // Adds 'key' to the signature.
+  void Add(const Key& key) {
+    uint64 bit = Hash(key);
+    bits_[bit / 64] |= 1ULL << (bit % 64);
+  }
+
+  // Returns true if this signature and 'other' have at least one bit in
+  // common, i.e. if their key sets may intersect.
+  bool Intersects(const Signature& other) const {
+    for (int i = 0; i < kWords; i++) {
+      if (bits_[i] & other.bits_[i])
+        return true;
+    }
+    return false;
+  }
+
+ private:
+  // Number of bits (and 64-bit words) in a signature.
+  static const int kBitsLog2 = 12;
+  static const int kWords = (1 << kBitsLog2) / 64;
+
+  // Maps a key to a bit position using multiplicative (Fibonacci) hashing.
+  static uint64 Hash(const Key& key) {
+    return (key * 0x9E3779B97F4A7C15ULL) >> (64 - kBitsLog2);
+  }
+
+  uint64 bits_[kWords];
+};
+
+#endif  // _SIGNATURE_H_
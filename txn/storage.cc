@@ -1,21 +1,121 @@
 #include "txn/storage.h"
 
-bool Storage::Read(Key key, Value* result) {
-  if (data_.count(key)) {
-    *result = data_[key];
-    return true;
-  } else {
-    return false;
+Storage::Storage()
+    : tid_words_(new uint64[kTidWords]()), ts_words_(new uint64[kTidWords]()) {
+}
+
+Storage::~Storage() {
+  delete[] tid_words_;
+  delete[] ts_words_;
+
+  for (int i = 0; i < kStripes; i++) {
+    unordered_map<Key, Version*>* versions = &stripes_[i].versions_;
+    for (unordered_map<Key, Version*>::iterator it = versions->begin();
+         it != versions->end(); ++it) {
+      while (it->second != NULL) {
+        Version* next = it->second->next_;
+        delete it->second;
+        it->second = next;
+      }
+    }
   }
 }
 
+bool Storage::Read(Key key, Value* result) {
+  Stripe* stripe = StripeOf(key);
+  stripe->latch_.ReadLock();
+  unordered_map<Key, Value>::iterator it = stripe->data_.find(key);
+  bool found = (it != stripe->data_.end());
+  if (found)
+    *result = it->second;
+  stripe->latch_.Unlock();
+  return found;
+}
+
 void Storage::Write(Key key, Value value) {
-  data_[key] = value;
-  timestamps_[key] = GetTime();
+  Stripe* stripe = StripeOf(key);
+  stripe->latch_.WriteLock();
+  stripe->data_[key] = value;
+  stripe->timestamps_[key] = GetTime();
+  stripe->latch_.Unlock();
+}
+
+void Storage::Delete(Key key) {
+  Stripe* stripe = StripeOf(key);
+  stripe->latch_.WriteLock();
+  stripe->data_.erase(key);
+  stripe->timestamps_[key] = GetTime();
+  stripe->latch_.Unlock();
+}
+
+void Storage::Add(Key key, Value delta) {
+  Stripe* stripe = StripeOf(key);
+  stripe->latch_.WriteLock();
+  stripe->data_[key] += delta;
+  stripe->timestamps_[key] = GetTime();
+  stripe->latch_.Unlock();
 }
 
 double Storage::Timestamp(Key key) {
-  if (timestamps_.count(key) == 0)
-    return 0;
-  return timestamps_[key];
+  Stripe* stripe = StripeOf(key);
+  stripe->latch_.ReadLock();
+  unordered_map<Key, double>::iterator it = stripe->timestamps_.find(key);
+  double timestamp = (it == stripe->timestamps_.end()) ? 0 : it->second;
+  stripe->latch_.Unlock();
+  return timestamp;
+}
+
+bool Storage::ReadVersion(Key key, uint64 ts, Value* result) {
+  Stripe* stripe = StripeOf(key);
+  stripe->latch_.ReadLock();
+  bool found = false;
+  unordered_map<Key, Version*>::iterator it = stripe->versions_.find(key);
+  if (it != stripe->versions_.end()) {
+    for (Version* version = it->second; version != NULL;
+         version = version->next_) {
+      if (version->ts_ <= ts) {
+        *result = version->value_;
+        found = true;
+        break;
+      }
+    }
+  }
+  stripe->latch_.Unlock();
+  return found;
+}
+
+void Storage::WriteVersion(Key key, Value value, uint64 ts,
+                           uint64 oldest_snapshot) {
+  Stripe* stripe = StripeOf(key);
+  stripe->latch_.WriteLock();
+  Version*& head = stripe->versions_[key];
+  Version* version = new Version(value, ts, head);
+  head = version;
+
+  // Everything behind the newest version visible to 'oldest_snapshot' is
+  // unreachable by any reader, so it can be freed.
+  for (Version* v = version; v != NULL; v = v->next_) {
+    if (v->ts_ <= oldest_snapshot) {
+      Version* garbage = v->next_;
+      v->next_ = NULL;
+      while (garbage != NULL) {
+        Version* next = garbage->next_;
+        delete garbage;
+        garbage = next;
+      }
+      break;
+    }
+  }
+  stripe->latch_.Unlock();
+}
+
+uint64 Storage::LatestVersion(Key key) {
+  Stripe* stripe = StripeOf(key);
+  stripe->latch_.ReadLock();
+  unordered_map<Key, Version*>::iterator it = stripe->versions_.find(key);
+  uint64 ts = 0;
+  if (it != stripe->versions_.end() && it->second != NULL)
+    ts = it->second->ts_;
+  stripe->latch_.Unlock();
+  return ts;
 }
@@ -10,13 +10,21 @@
 
 #include "txn/common.h"
 #include "txn/txn.h"
+#include "utils/mutex.h"
 
 using std::tr1::unordered_map;
 using std::deque;
 using std::map;
 
+// Records are striped over a fixed number of hash tables, each guarded by a
+// latch, so any number of threads may read, insert and update records
+// concurrently. Latches only make individual calls atomic: keeping a txn's
+// reads and writes consistent is still up to concurrency control.
 class Storage {
  public:
+  Storage();
+  ~Storage();
+
   // If there exists a record for the specified key, sets '*result' equal to
   // the value associated with the key and returns true, else returns false;
   bool Read(Key key, Value* result);
@@ -25,16 +33,90 @@ class Storage {
   // same key.
   void Write(Key key, Value value);
 
+  // Removes the record with the specified key, if any.
+  void Delete(Key key);
+
+  // Atomically adds 'delta' to the record with the specified key (treating a
+  // missing record as 0).
+  void Add(Key key, Value delta);
+
   // Returns the timestamp at which the record with the specified key was last
   // updated (returns 0 if the record has never been updated).
   double Timestamp(Key key);
 
+  // Returns the TID word guarding the record with the specified key (used by
+  // SILO). TID words are striped over a fixed-size table, so two keys may
+  // share a word; this only ever causes spurious conflicts, never missed ones.
+  //
+  // Layout: [ epoch : 32 | sequence : 31 | lock : 1 ]
+  volatile uint64* TidWord(Key key) { return &tid_words_[key % kTidWords]; }
+
+  // Returns the timestamp word guarding the record with the specified key
+  // (used by TICTOC). Timestamp words are striped in the same way as TID words.
+  //
+  // Layout: [ lock : 1 | rts - wts : 15 | wts : 48 ]
+  volatile uint64* TsWord(Key key) { return &ts_words_[key % kTidWords]; }
+
+  // Number of TID (and timestamp) words in each striped table.
+  static const int kTidWords = 1 << 16;
+
+  // Multiversion interface (used by SSI).
+
+  // If the record with the specified key has a version committed at or before
+  // timestamp 'ts', sets '*result' equal to the latest such version's value
+  // and returns true, else returns false.
+  bool ReadVersion(Key key, uint64 ts, Value* result);
+
+  // Installs a new version <key, value> committed at timestamp 'ts', which
+  // must be larger than that of any existing version of the record. Versions
+  // that are not visible to any snapshot at or after 'oldest_snapshot' are
+  // discarded.
+  void WriteVersion(Key key, Value value, uint64 ts, uint64 oldest_snapshot);
+
+  // Returns the timestamp at which the latest version of the record with the
+  // specified key was committed (returns 0 if the record has no versions).
+  uint64 LatestVersion(Key key);
+
  private:
-  // Collection of <key, value> pairs.
-  unordered_map<Key, Value> data_;
+  // A committed version of a record. Versions of each record form a list
+  // ordered from newest to oldest.
+  struct Version {
+    Version(Value value, uint64 ts, Version* next)
+        : value_(value), ts_(ts), next_(next) {}
+    Value value_;     // Value of the record as of this version.
+    uint64 ts_;       // Timestamp at which this version was committed.
+    Version* next_;   // Next older version (NULL if none is retained).
+  };
+
+  // Records whose keys are equal modulo kStripes.
+  struct Stripe {
+    // Held exclusively while any of the tables below is modified.
+    MutexRW latch_;
+
+    // Collection of <key, value> pairs.
+    unordered_map<Key, Value> data_;
+
+    // Timestamps at which each key was last updated.
+    unordered_map<Key, double> timestamps_;
+
+    // Newest version of each record (see 'ReadVersion()').
+    unordered_map<Key, Version*> versions_;
+  };
+
+  // Returns the stripe holding the record with the specified key.
+  Stripe* StripeOf(Key key) { return &stripes_[key % kStripes]; }
+
+  // Number of stripes.
+  static const int kStripes = 64;
+
+  // Striped record tables.
+  Stripe stripes_[kStripes];
+
+  // Striped per-record TID words (see 'TidWord()').
+  volatile uint64* tid_words_;
 
-  // Timestamps at which each key was last updated.
-  unordered_map<Key, double> timestamps_;
+  // Striped per-record timestamp words (see 'TsWord()').
+  volatile uint64* ts_words_;
 };
 
 #endif  // _STORAGE_H_
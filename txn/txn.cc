@@ -2,9 +2,16 @@
 
 #include "txn/txn.h"
 
+#include "txn/storage.h"
+
+// Scheduling slack per priority class below PRIORITY_HIGH, in seconds (see
+// 'Txn::SchedulingDeadline()').
+#define PRIORITY_AGING 0.01
+
 bool Txn::Read(const Key& key, Value* value) {
   // Check that key is in readset/writeset.
-  if (readset_.count(key) == 0 && writeset_.count(key) == 0)
+  if (readset_.count(key) == 0 && writeset_.count(key) == 0 &&
+      reconset_.count(key) == 0)
     DIE("Invalid read (key not in readset or writeset).");
 
   // Reads have no effect if we have already aborted or committed.
@@ -13,8 +20,9 @@ bool Txn::Read(const Key& key, Value* value) {
 
   // 'reads_' has already been populated by TxnProcessor, so it should contain
   // the target value iff the record appears in the database.
-  if (reads_.count(key)) {
-    *value = reads_[key];
+  ValueMap::iterator it = reads_.find(key);
+  if (it != reads_.end()) {
+    *value = it->second;
     return true;
   } else {
     return false;
@@ -30,29 +38,91 @@ void Txn::Write(const Key& key, const Value& value) {
   if (status_ != INCOMPLETE)
     return;
 
-  // Set key-value pair in write buffer.
-  writes_[key] = value;
+  if (inplace_storage_ != NULL) {
+    // Save the record's before-image the first time it is written, then
+    // update it in place.
+    bool logged = false;
+    for (vector<UndoRecord>::iterator it = undo_log_.begin();
+         it != undo_log_.end(); ++it) {
+      if (it->key_ == key) {
+        logged = true;
+        break;
+      }
+    }
+    if (!logged) {
+      UndoRecord undo;
+      undo.key_ = key;
+      undo.value_ = 0;
+      undo.existed_ = inplace_storage_->Read(key, &undo.value_);
+      undo_log_.push_back(undo);
+    }
+    inplace_storage_->Write(key, value);
+  } else {
+    // Set key-value pair in write buffer.
+    writes_[key] = value;
+  }
 
   // Also set key-value pair in read results in case txn logic requires the
   // record to be re-read.
   reads_[key] = value;
 }
 
+void Txn::Increment(const Key& key, int64 delta) {
+  // Check that key is in deltaset.
+  if (deltaset_.count(key) == 0)
+    DIE("Invalid increment of key " << key << " (deltaset).");
+
+  // Increments have no effect if we have already aborted or committed.
+  if (status_ != INCOMPLETE)
+    return;
+
+  // Accumulate the delta. Values wrap, so negative deltas work too.
+  deltas_[key] += static_cast<Value>(delta);
+}
+
 void Txn::CheckReadWriteSets() {
-  for (set<Key>::iterator it = writeset_.begin();
+  for (KeySet::iterator it = writeset_.begin();
        it != writeset_.end(); ++it) {
     if (readset_.count(*it) > 0) {
       DIE("Overlapping read/write sets\n.");
     }
   }
+  for (KeySet::iterator it = deltaset_.begin();
+       it != deltaset_.end(); ++it) {
+    if (readset_.count(*it) > 0 || writeset_.count(*it) > 0) {
+      DIE("Overlapping delta set\n.");
+    }
+  }
 }
 
 void Txn::CopyTxnInternals(Txn* txn) const {
-  txn->readset_ = set<Key>(this->readset_);
-  txn->writeset_ = set<Key>(this->writeset_);
-  txn->reads_ = map<Key, Value>(this->reads_);
-  txn->writes_ = map<Key, Value>(this->writes_);
+  txn->readset_ = this->readset_;
+  txn->writeset_ = this->writeset_;
+  txn->reads_ = this->reads_;
+  txn->writes_ = this->writes_;
+  txn->reconset_ = this->reconset_;
+  txn->deltaset_ = this->deltaset_;
+  txn->deltas_ = this->deltas_;
   txn->status_ = this->status_;
   txn->unique_id_ = this->unique_id_;
   txn->occ_start_time_ = this->occ_start_time_;
+  txn->read_versions_ = this->read_versions_;
+  txn->snapshot_ts_ = this->snapshot_ts_;
+  txn->occ_retries_ = this->occ_retries_;
+  txn->inplace_storage_ = this->inplace_storage_;
+  txn->undo_log_ = vector<UndoRecord>(this->undo_log_);
+  txn->callback_ = this->callback_;
+  txn->priority_ = this->priority_;
+  txn->deadline_ = this->deadline_;
+  txn->submit_time_ = this->submit_time_;
+  txn->resume_point_ = this->resume_point_;
+  txn->wake_time_ = this->wake_time_;
+  txn->suspendable_ = this->suspendable_;
+}
+
+double Txn::SchedulingDeadline() const {
+  double deadline = submit_time_ + (PRIORITY_HIGH - priority_) * PRIORITY_AGING;
+  if (deadline_ != 0 && deadline_ < deadline)
+    deadline = deadline_;
+  return deadline;
 }
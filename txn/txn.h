@@ -8,11 +8,30 @@
 #include <vector>
 
 #include "txn/common.h"
+#include "utils/flat_set.h"
 
 using std::map;
 using std::set;
 using std::vector;
 
+class Storage;
+class TxnCallback;
+
+// Containers for the keys a txn accesses, and for values associated with
+// them. Sorted arrays that hold their first elements without allocating
+// memory (see FlatArray). Most txns read no more than 20 records and write no
+// more than 10, which sizes KeySet and ValueMap (used for reads) and their
+// Small versions (used for writes). The Sparse versions keep nothing inline,
+// and are used for the sets most txns leave empty, so that those add little
+// to the size of each txn. All versions share the iterator types of KeySet
+// and ValueMap.
+typedef FlatSet<Key, 20> KeySet;
+typedef FlatMap<Key, Value, 20> ValueMap;
+typedef FlatSet<Key, 10> SmallKeySet;
+typedef FlatMap<Key, Value, 10> SmallValueMap;
+typedef FlatSet<Key, 0> SparseKeySet;
+typedef FlatMap<Key, Value, 0> SparseValueMap;
+
 // Txns can have five distinct status values:
 enum TxnStatus {
   INCOMPLETE = 0,   // Not yet executed
@@ -22,21 +41,81 @@ enum TxnStatus {
   ABORTED = 4,      // Aborted
 };
 
+// Txns are scheduled by priority class. Within a class, txns are scheduled in
+// the order they were submitted, but a txn that has waited long enough is
+// scheduled ahead of newer txns of a higher class (see
+// 'Txn::SchedulingDeadline()').
+enum TxnPriority {
+  PRIORITY_LOW = 0,     // Background work
+  PRIORITY_NORMAL = 1,  // Default
+  PRIORITY_HIGH = 2,    // Latency-critical
+};
+
 class Txn {
  public:
   // Commit vote defauls to false. Only by calling "commit"
-  Txn() : status_(INCOMPLETE) {}
+  Txn()
+      : status_(INCOMPLETE), occ_retries_(0), inplace_storage_(NULL),
+        callback_(NULL), priority_(PRIORITY_NORMAL), deadline_(0),
+        submit_time_(0), resume_point_(0), wake_time_(0),
+        suspendable_(false) {}
   virtual ~Txn() {}
   virtual Txn * clone() const = 0;    // Virtual constructor (copying)
 
   // Method containing all the transaction's method logic.
   virtual void Run() = 0;
 
+  // Repairs an executed txn some of whose reads turned out to be stale,
+  // instead of re-running it from scratch (used by HEALING). Called on an
+  // INCOMPLETE txn with 'reads_' already refreshed for every key in 'stale';
+  // must redo exactly those operations of 'Run()' whose inputs changed, and
+  // then vote with COMMIT or ABORT just like 'Run()'. A txn that is left
+  // INCOMPLETE cannot be healed, and is re-executed instead.
+  //
+  // The default implementation cannot heal anything.
+  virtual void Heal(const KeySet& stale) {}
+
+  // Reconnaissance phase of a txn whose read/write sets depend on the data it
+  // reads (optimistic lock location prediction). A txn that declares a
+  // nonempty 'reconset_' must compute its readset, writeset and deltaset here
+  // from the values of the reconset keys, obtained with 'Read()'. The readset
+  // must include the reconset itself.
+  //
+  // The TxnProcessor runs 'Recon()' against unlocked data when the txn is
+  // submitted, and again against the data actually read once the txn is
+  // scheduled. If the two disagree, the txn is not run but restarted with
+  // fresh sets. Only supported in SERIAL and the locking modes
+  // (LOCKING_EXCLUSIVE_ONLY, LOCKING, LOCKING_ELR, LOCKING_BATCH and
+  // LOCKING_IN_PLACE); other modes abort such txns without running them.
+  virtual void Recon() {}
+
+  // Returns true if 'Run()' never aborts, so that the txn's outcome is known
+  // before it is run. LAZY mode defers the execution of such txns.
+  virtual bool NeverAborts() const { return false; }
+
   // Returns the Txn's current execution status.
   TxnStatus Status() { return status_; }
 
-  // Checks for overlap in read and write sets. If any key appears in both,
-  // an error occurs.
+  // Sets the txn's priority class. Must be called before the txn is
+  // submitted.
+  void SetPriority(TxnPriority priority) { priority_ = priority; }
+  TxnPriority Priority() const { return priority_; }
+
+  // Sets a time (as returned by 'GetTime()') by which the txn should be
+  // scheduled, or 0 for none (the default). Must be called before the txn is
+  // submitted.
+  void SetDeadline(double deadline) { deadline_ = deadline; }
+  double Deadline() const { return deadline_; }
+
+  // Returns the time by which the txn should be scheduled: its deadline, or
+  // if it has none or the deadline is later, its submission time plus a
+  // slack that grows as its priority class drops. Txns are scheduled in
+  // increasing order of this time, so that waiting txns age into the
+  // priority of newer ones.
+  double SchedulingDeadline() const;
+
+  // Checks for overlap in read, write and delta sets. If any key appears in
+  // more than one, an error occurs.
   void CheckReadWriteSets();
 
  protected:
@@ -51,19 +130,31 @@ class Txn {
   // the database. If record corresponding with specified 'key' exists, sets
   // '*value' equal to the record value and returns true, else returns false.
   //
-  // Requires: key appears in readset or writeset
+  // Requires: key appears in readset or writeset (or, inside 'Recon()', in
+  //           reconset)
   //
   // Note: Can ONLY be called from inside the 'Execute()' function.
   bool Read(const Key& key, Value* value);
 
   // Method to be used inside 'Execute()' function when writing records to
-  // the database.
+  // the database. Writes are buffered until commit, unless the txn is run
+  // with 'inplace_storage_' set (which requires an exclusive lock on the key).
   //
   // Requires: key appears in writeset
   //
   // Note: Can ONLY be called from inside the 'Execute()' function.
   void Write(const Key& key, const Value& value);
 
+  // Method to be used inside 'Execute()' function when adding 'delta' to a
+  // counter record. Increments are blind and commute with one another, so
+  // concurrent txns incrementing the same record never conflict; they are
+  // merged into the record at commit.
+  //
+  // Requires: key appears in deltaset
+  //
+  // Note: Can ONLY be called from inside the 'Execute()' function.
+  void Increment(const Key& key, int64 delta);
+
   // Macro to be used inside 'Execute()' function when deciding to COMMIT.
   //
   // Note: Can ONLY be called from inside the 'Execute()' function.
@@ -82,18 +173,61 @@ class Txn {
       return; \
     } while (0)
 
+  // Macro to be used inside 'Execute()' function to wait for 'duration'
+  // seconds (e.g. for simulated I/O) without tying up a thread. When the
+  // TxnProcessor can suspend the txn, 'Execute()' returns right away, and is
+  // called again after the wait, continuing right behind the 'WAIT()'.
+  // Otherwise, the calling thread sleeps.
+  //
+  // Local variables do not survive a wait, so any state needed afterwards
+  // must be kept in members. The body of 'Execute()' must be enclosed in
+  // 'TXN_BEGIN' and 'TXN_END', and may not declare initialized local
+  // variables in that scope (enclose them in a nested block).
+  //
+  // Note: Can ONLY be called from inside the 'Execute()' function.
+  #define WAIT(duration) \
+    do { \
+      if (!suspendable_) { \
+        Sleep(duration); \
+        break; \
+      } \
+      wake_time_ = GetTime() + (duration); \
+      resume_point_ = __LINE__; \
+      return; \
+      case __LINE__: \
+        resume_point_ = 0; \
+    } while (0)
+
+  // Macros enclosing the body of an 'Execute()' function that uses 'WAIT()'.
+  #define TXN_BEGIN switch (resume_point_) { case 0:
+  #define TXN_END }
+
+  // Returns true if the txn is suspended in a 'WAIT()'.
+  bool Suspended() const { return resume_point_ != 0; }
+
   // Set of all keys that may need to be read in order to execute the
   // transaction.
-  set<Key> readset_;
+  KeySet readset_;
 
   // Set of all keys that may be updated when executing the transaction.
-  set<Key> writeset_;
+  SmallKeySet writeset_;
+
+  // Set of all keys whose values determine the txn's other sets (see
+  // 'Recon()'). Empty for txns whose sets are known up front.
+  SparseKeySet reconset_;
+
+  // Set of all keys that may be incremented (see 'Increment()') when
+  // executing the transaction. Disjoint from both readset and writeset.
+  SparseKeySet deltaset_;
 
   // Results of reads performed by the transaction.
-  map<Key, Value> reads_;
+  ValueMap reads_;
 
   // Key, Value pairs WRITTEN by the transaction.
-  map<Key, Value> writes_;
+  SmallValueMap writes_;
+
+  // Total amount added to each record INCREMENTED by the transaction.
+  SparseValueMap deltas_;
 
   // Transaction's current execution status.
   TxnStatus status_;
@@ -105,6 +239,50 @@ class Txn {
 
   // Start time (used for OCC and MVCC).
   double occ_start_time_;
+
+  // Version words observed for each record read (TID words for SILO,
+  // timestamp words for TICTOC).
+  SparseValueMap read_versions_;
+
+  // Timestamp of the snapshot the txn reads from (used by SSI).
+  uint64 snapshot_ts_;
+
+  // Number of times the txn has failed validation (used by H_OCC).
+  int occ_retries_;
+
+  // Storage that 'Write()' updates directly, or NULL if writes are buffered
+  // in 'writes_' until commit (used by LOCKING_IN_PLACE).
+  Storage* inplace_storage_;
+
+  // Before-image of a record updated in place.
+  struct UndoRecord {
+    Key key_;
+    Value value_;    // Value of the record before the txn's first write.
+    bool existed_;   // False if the record did not exist yet.
+  };
+
+  // Before-images of all records updated in place, in the order they were
+  // first written.
+  vector<UndoRecord> undo_log_;
+
+  // Receiver of the txn's result, or NULL if it goes to 'GetTxnResult()'.
+  TxnCallback* callback_;
+
+  // Scheduling priority class and deadline (0 if none).
+  TxnPriority priority_;
+  double deadline_;
+
+  // Time at which the txn was submitted.
+  double submit_time_;
+
+  // Line of the 'WAIT()' the txn is suspended in (0 if it is not suspended),
+  // and the time at which it is to be resumed.
+  int resume_point_;
+  double wake_time_;
+
+  // True if 'WAIT()' may suspend the txn, rather than sleep. Set by the
+  // TxnProcessor while running 'Execute()' on a worker thread.
+  bool suspendable_;
 };
 
 #endif  // _TXN_H_
@@ -2,72 +2,623 @@
 // Modified by: Christina Wallin (christina.wallin@yale.edu)
 
 #include "txn/txn_processor.h"
+#include <limits.h>
+#include <math.h>
+#include <sched.h>
 #include <stdio.h>
 
+#include <algorithm>
 #include <set>
+#include <vector>
 
 #include "txn/lock_manager.h"
 #include "txn/txn_types.h"
 
-// Thread & queue counts for StaticThreadPool initialization.
-#define THREAD_COUNT 100
-#define QUEUE_COUNT 10
-
 // Maximum number of transactions to deal with during validation and
 // post-validation.
 #define VALIDATION_MAX      10
 #define POST_VALIDATION_MAX 100
 
+// Number of failed validations after which an H_OCC txn is re-run under
+// locks, and the bounds (in seconds) of the exponential backoff applied to
+// retries before that.
+#define HOCC_MAX_RETRIES  3
+#define HOCC_BACKOFF_BASE 0.0001
+#define HOCC_BACKOFF_MAX  0.01
+
+// Tuning of the ADAPTIVE scheduler. Statistics are gathered over windows of
+// ADAPT_WINDOW seconds, extended until at least ADAPT_MIN_SAMPLES txns have
+// finished. Every protocol is re-measured at least once every
+// ADAPT_PROBE_WINDOWS windows, and the scheduler only switches to a protocol
+// that measured more than ADAPT_HYSTERESIS better than the current one. The
+// remaining thresholds mark the current protocol as a poor fit: OCC restarting
+// more than ADAPT_MAX_RESTARTS txns per finished txn, LOCKING spending less
+// than ADAPT_MIN_WAIT_RATIO of its time waiting for locks, SERIAL running
+// txns longer than ADAPT_LONG_TXN seconds, or any concurrent protocol running
+// txns shorter than ADAPT_SHORT_TXN seconds.
+#define ADAPT_WINDOW         0.02
+#define ADAPT_MIN_SAMPLES    10
+#define ADAPT_PROBE_WINDOWS  25
+#define ADAPT_HYSTERESIS     0.1
+#define ADAPT_MAX_RESTARTS   0.5
+#define ADAPT_MIN_WAIT_RATIO 0.05
+#define ADAPT_SHORT_TXN      0.00005
+#define ADAPT_LONG_TXN       0.0005
+
+// Maximum number of requests handled per iteration of every scheduler loop
+// (and, separately, of finished txns in the SERIAL, LOCKING, OCC, P_OCC,
+// SILO, TICTOC and SSI loops), and the time (in seconds) after which a parked
+// idle scheduler (or PARTITIONED partition) checks for work even if it has not
+// been woken up.
+#define SCHEDULER_BATCH        32
+#define SCHEDULER_PARK_TIMEOUT 0.001
+
+// Admission control. Unless configured otherwise (see 'ExecutorOptions'), the
+// number of txns in flight starts out limited to ADMIT_INITIAL_LIMIT, and is
+// adapted within [ADMIT_MIN_LIMIT, ADMIT_MAX_LIMIT] at the end of every window
+// of at least ADMIT_WINDOW seconds and ADMIT_MIN_SAMPLES finished txns: raised
+// by ADMIT_INCREASE, or multiplied by ADMIT_DECREASE. Throughput changes within
+// ADMIT_TOLERANCE count as no change, and more than ADMIT_MAX_RESTARTS
+// restarts per finished txn count as thrashing.
+#define ADMIT_INITIAL_LIMIT 64
+#define ADMIT_MIN_LIMIT     4
+#define ADMIT_MAX_LIMIT     1024
+#define ADMIT_WINDOW        0.02
+#define ADMIT_MIN_SAMPLES   20
+#define ADMIT_INCREASE      4
+#define ADMIT_DECREASE      0.8
+#define ADMIT_TOLERANCE     0.1
+#define ADMIT_MAX_RESTARTS  1.0
+
+// Maximum number of txn requests reordered together by LOCKING_BATCH.
+#define REORDER_BATCH_SIZE 16U
+
+// Number of attempts a read-only txn makes to read a consistent snapshot
+// before falling back to the regular path.
+#define SNAPSHOT_MAX_RETRIES 100
+
+// Maximum number of txns deferred by LAZY at any time, and number of
+// deferred txns run whenever the LAZY scheduler is idle.
+#define LAZY_MAX_DEFERRED 10000
+#define LAZY_IDLE_BATCH   16
+
+// Interval (in seconds) at which the SILO global epoch is advanced.
+#define SILO_EPOCH_INTERVAL 0.04
+
+// Fields of a SILO TID word (see 'Storage::TidWord()').
+#define TID_LOCK_BIT    1ULL
+#define TID_SEQ_STEP    2ULL
+#define TID_EPOCH_SHIFT 32
+
 // Quick define for being specific to a MODE
 #define MODE_NONE -1
 #define MODE_DEBUG MODE_NONE
 #define MODE_PRINT(MSG) if (mode_ == MODE_DEBUG) { MSG; }
 
-TxnProcessor::TxnProcessor(CCMode mode)
-    : mode_(mode), tp_(THREAD_COUNT, QUEUE_COUNT), next_unique_id_(1) {
+// Fields of a TICTOC timestamp word (see 'Storage::TsWord()').
+#define TS_LOCK_BIT    (1ULL << 63)
+#define TS_DELTA_SHIFT 48
+#define TS_DELTA_MAX   0x7fffULL
+#define TS_WTS_MASK    ((1ULL << TS_DELTA_SHIFT) - 1)
+
+// Most recent TID generated by the current worker thread (used by SILO).
+static __thread uint64 silo_last_tid = 0;
+
+// Returns the write timestamp stored in a TICTOC timestamp word.
+static inline uint64 TsWts(uint64 word) {
+  return word & TS_WTS_MASK;
+}
+
+// Returns the read timestamp stored in a TICTOC timestamp word.
+static inline uint64 TsRts(uint64 word) {
+  return TsWts(word) + ((word >> TS_DELTA_SHIFT) & TS_DELTA_MAX);
+}
+
+// Returns an unlocked TICTOC timestamp word with the specified timestamps. If
+// 'rts' is too far ahead of 'wts' to be encoded, 'wts' is moved forward; this
+// only causes readers of the old version to fail validation.
+static inline uint64 MakeTsWord(uint64 wts, uint64 rts) {
+  if (rts - wts > TS_DELTA_MAX)
+    wts = rts - TS_DELTA_MAX;
+  return ((rts - wts) << TS_DELTA_SHIFT) | wts;
+}
+
+// Sorts and deduplicates '*words', then sets 'lock_bit' in each of them,
+// spinning while another thread holds it. Locking in address order means that
+// concurrent callers can never deadlock.
+static void LockWords(vector<volatile uint64*>* words, uint64 lock_bit) {
+  sort(words->begin(), words->end());
+  words->erase(unique(words->begin(), words->end()), words->end());
+
+  for (vector<volatile uint64*>::iterator it = words->begin();
+       it != words->end(); ++it) {
+    uint64 word = **it & ~lock_bit;
+    while (!__sync_bool_compare_and_swap(*it, word, word | lock_bit)) {
+      sched_yield();
+      word = **it & ~lock_bit;
+    }
+  }
+}
+
+// Returns true if the sorted sets 'a' and 'b' have an element in common.
+template<class SetA, class SetB>
+static bool Intersect(const SetA& a, const SetB& b) {
+  KeySet::const_iterator i = a.begin(), j = b.begin();
+  while (i != a.end() && j != b.end()) {
+    if (*i < *j)
+      ++i;
+    else if (*j < *i)
+      ++j;
+    else
+      return true;
+  }
+  return false;
+}
+
+// Returns true if 'a' should be scheduled before 'b'.
+static bool MoreUrgent(Txn* a, Txn* b) {
+  return a->SchedulingDeadline() < b->SchedulingDeadline();
+}
+
+// Clears 'lock_bit' in each of 'words' without otherwise changing them.
+static void UnlockWords(const vector<volatile uint64*>& words,
+                        uint64 lock_bit) {
+  for (vector<volatile uint64*>::const_iterator it = words.begin();
+       it != words.end(); ++it) {
+    **it = **it & ~lock_bit;
+  }
+}
+
+ExecutorOptions ExecutorOptions::ThreadPerCore() {
+  ExecutorOptions options;
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  sched_getaffinity(0, sizeof(cpuset), &cpuset);
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &cpuset))
+      options.cpus_.push_back(cpu);
+  }
+  if (options.cpus_.empty())
+    options.cpus_.push_back(0);
+  options.thread_count_ = options.cpus_.size();
+  options.queue_count_ = options.cpus_.size();
+  options.routing_ = ROUTE_KEY_AFFINITY;
+  return options;
+}
+
+TxnProcessor::TxnProcessor(CCMode mode, const ExecutorOptions& options)
+    : mode_(mode),
+      tp_(options.thread_count_, options.queue_count_, options.cpus_),
+      routing_(options.routing_), next_unique_id_(1),
+      validation_seq_(0), lazy_seq_(0), epoch_(1), ssi_clock_(0) {
+  for (int i = 0; i < kValidationSlots; i++) {
+    validation_slots_[i].taken_ = 0;
+    validation_slots_[i].seq_ = 0;
+  }
+  retry_stats_.validation_failures_ = 0;
+  retry_stats_.heals_ = 0;
+  retry_stats_.fallbacks_ = 0;
+  retry_stats_.backoffs_ = 0;
+  retry_stats_.backoff_time_ = 0;
+  retry_stats_.max_retries_ = 0;
+  for (int i = 0; i < ADAPTIVE; i++) {
+    adaptive_throughput_[i] = 0;
+    adaptive_age_[i] = 0;
+  }
+
+  log_flush_latency_ = options.log_flush_latency_;
+
+  // Snapshot reads are serializable wherever installed writes are only ever
+  // read by txns ordered after them (locks, or validation against
+  // 'committing_keys_'). Under a simulated log, they could also expose writes
+  // that are not durable yet. LOCKING_IN_PLACE is left out, as its txns
+  // expose their writes in storage while they run, and SERIAL so that it
+  // remains the baseline that runs every txn one at a time.
+  snapshot_reads_ = (mode_ == OCC ||
+                     (log_flush_latency_ == 0 &&
+                      (mode_ == LOCKING_EXCLUSIVE_ONLY || mode_ == LOCKING ||
+                       mode_ == LOCKING_ELR || mode_ == LOCKING_BATCH)));
+  recon_supported_ = (mode_ == SERIAL || mode_ == LOCKING_EXCLUSIVE_ONLY ||
+                      mode_ == LOCKING || mode_ == LOCKING_ELR ||
+                      mode_ == LOCKING_BATCH || mode_ == LOCKING_IN_PLACE);
+  installing_ = 0;
+  install_seq_ = 0;
+
+  in_flight_ = 0;
+  admission_adaptive_ =
+      (options.admission_limit_ == ExecutorOptions::kAdaptiveAdmission);
+  if (admission_adaptive_)
+    admission_limit_ = ADMIT_INITIAL_LIMIT;
+  else if (options.admission_limit_ == ExecutorOptions::kUnlimitedAdmission)
+    admission_limit_ = INT_MAX;
+  else
+    admission_limit_ = options.admission_limit_;
+  admission_window_start_ = GetTime();
+  admission_finished_ = 0;
+  admission_restarts_ = 0;
+  admission_saturated_ = false;
+  admission_throughput_ = 0;
+  admission_increasing_ = true;
+
+  for (int i = 0; i <= PRIORITY_HIGH; i++) {
+    for (int j = 0; j < kLatencyBuckets; j++)
+      latency_buckets_[i][j] = 0;
+    latency_sum_[i] = 0;
+    latency_max_[i] = 0;
+  }
+
   MODE_PRINT(DERROR("Creating new Txn Processor. Mode = %d\n", mode))
   if (mode_ == LOCKING_EXCLUSIVE_ONLY)
     lm_ = new LockManagerA(&ready_txns_);
-  else if (mode_ == LOCKING)
+  else if (mode_ == LOCKING || mode_ == LOCKING_ELR ||
+           mode_ == LOCKING_BATCH || mode_ == LOCKING_IN_PLACE ||
+           mode_ == H_OCC || mode_ == ADAPTIVE)
     lm_ = new LockManagerB(&ready_txns_);
+  else
+    lm_ = NULL;
 
-  // Start 'RunScheduler()' running as a new task in its own thread.
-  tp_.RunTask(
+  // Start 'RunScheduler()' and 'RunWaker()' running as new tasks in their own
+  // threads.
+  tp_.RunDedicatedTask(
         new Method<TxnProcessor, void>(this, &TxnProcessor::RunScheduler));
+  tp_.RunDedicatedTask(
+        new Method<TxnProcessor, void>(this, &TxnProcessor::RunWaker));
 }
 
 TxnProcessor::~TxnProcessor() {
-  if (mode_ == LOCKING_EXCLUSIVE_ONLY || mode_ == LOCKING)
-    delete lm_;
+  // Stop all threads before tearing down the state they use.
+  tp_.Stop();
+  delete lm_;
+
+  // Txns still deferred by LAZY are owned by the TxnProcessor.
+  for (map<uint64, LazyTxn>::iterator it = lazy_txns_.begin();
+       it != lazy_txns_.end(); ++it)
+    delete it->second.txn_;
 }
 
 void TxnProcessor::NewTxnRequest(Txn* txn) {
-  // Atomically assign the txn a new number and add it to the incoming txn
-  // requests queue.
-  mutex_.Lock();
-  txn->unique_id_ = next_unique_id_;
-  next_unique_id_++;
-  txn_requests_.Push(txn);
-  mutex_.Unlock();
+  NewTxnRequest(txn, NULL);
+}
+
+void TxnProcessor::NewTxnRequest(Txn* txn, TxnCallback* callback) {
+  txn->submit_time_ = GetTime();
+  ReserveSlot(txn->priority_);
+  if (AdmitTxn(txn, callback)) {
+    txn_requests_.Push(txn);
+    scheduler_work_.Notify();
+  }
+}
+
+bool TxnProcessor::TryNewTxnRequest(Txn* txn, TxnCallback* callback) {
+  txn->submit_time_ = GetTime();
+  if (!TryReserveSlot(txn->priority_))
+    return false;
+  if (AdmitTxn(txn, callback)) {
+    txn_requests_.Push(txn);
+    scheduler_work_.Notify();
+  }
+  return true;
+}
+
+void TxnProcessor::NewTxnRequests(const vector<Txn*>& txns,
+                                  TxnCallback* callback) {
+  double now = GetTime();
+  vector<Txn*> requests;
+  for (vector<Txn*>::const_iterator it = txns.begin(); it != txns.end();
+       ++it) {
+    (*it)->submit_time_ = now;
+    if (!TryReserveSlot((*it)->priority_)) {
+      // Queue the txns admitted so far before waiting, as it may take one of
+      // them finishing to free a slot.
+      txn_requests_.PushBatch(requests);
+      scheduler_work_.Notify();
+      requests.clear();
+      ReserveSlot((*it)->priority_);
+    }
+    if (AdmitTxn(*it, callback))
+      requests.push_back(*it);
+  }
+  txn_requests_.PushBatch(requests);
+  scheduler_work_.Notify();
+}
+
+bool TxnProcessor::TryReserveSlot(TxnPriority priority) {
+  while (true) {
+    int in_flight = in_flight_;
+    if (in_flight >= admission_limit_ && priority != PRIORITY_HIGH) {
+      admission_saturated_ = true;
+      return false;
+    }
+    if (__sync_bool_compare_and_swap(&in_flight_, in_flight, in_flight + 1))
+      return true;
+  }
+}
+
+void TxnProcessor::ReserveSlot(TxnPriority priority) {
+  while (!TryReserveSlot(priority)) {
+    int key = admission_ready_.PrepareWait();
+    if (in_flight_ < admission_limit_) {
+      admission_ready_.CancelWait();
+      continue;
+    }
+    admission_ready_.Wait(key);
+  }
+}
+
+void TxnProcessor::ReleaseSlot() {
+  __sync_fetch_and_sub(&in_flight_, 1);
+  __sync_fetch_and_add(&admission_finished_, 1);
+  admission_ready_.Notify();
+
+  if (admission_adaptive_ &&
+      GetTime() >= admission_window_start_ + ADMIT_WINDOW &&
+      admission_mutex_.TryLock()) {
+    AdaptAdmissionLimit();
+    admission_mutex_.Unlock();
+  }
+}
+
+void TxnProcessor::AdaptAdmissionLimit() {
+  double now = GetTime();
+  int finished = admission_finished_;
+  if (now < admission_window_start_ + ADMIT_WINDOW ||
+      finished < ADMIT_MIN_SAMPLES)
+    return;
+
+  // Throughput only counts finished txns, so time lost to aborts and restarts
+  // under contention shows up as a drop. Restarts are also counted directly:
+  // a thrashing workload can keep its throughput up for a while (e.g. while
+  // restarted txns still hit in the cache) and yet gain nothing from more
+  // txns in flight.
+  double throughput = finished / (now - admission_window_start_);
+  int restarts = admission_restarts_;
+  bool thrashing = restarts > finished * ADMIT_MAX_RESTARTS;
+
+  // A limit that was not reached says nothing about how many txns in flight
+  // are too many.
+  if (admission_saturated_) {
+    int limit = admission_limit_;
+    if (admission_increasing_) {
+      // Keep growing only while it pays off, so that the limit settles at the
+      // smallest value that gives peak throughput.
+      if (throughput > admission_throughput_ * (1 + ADMIT_TOLERANCE) &&
+          !thrashing && limit < ADMIT_MAX_LIMIT) {
+        limit = std::min(ADMIT_MAX_LIMIT, limit + ADMIT_INCREASE);
+      } else {
+        admission_increasing_ = false;
+        limit = std::max(ADMIT_MIN_LIMIT,
+                         static_cast<int>(limit * ADMIT_DECREASE));
+      }
+    } else {
+      // Keep shrinking while the workload thrashes, even at some cost in
+      // throughput.
+      if ((throughput < admission_throughput_ * (1 - ADMIT_TOLERANCE) &&
+           !thrashing) || limit <= ADMIT_MIN_LIMIT) {
+        admission_increasing_ = true;
+        limit = std::min(ADMIT_MAX_LIMIT, limit + ADMIT_INCREASE);
+      } else {
+        limit = std::max(ADMIT_MIN_LIMIT,
+                         static_cast<int>(limit * ADMIT_DECREASE));
+      }
+    }
+    admission_limit_ = limit;
+
+    // Clients may be waiting for the limit to grow.
+    admission_ready_.NotifyAll();
+  }
+
+  __sync_fetch_and_sub(&admission_finished_, finished);
+  __sync_fetch_and_sub(&admission_restarts_, restarts);
+  admission_saturated_ = false;
+  admission_throughput_ = throughput;
+  admission_window_start_ = now;
+}
+
+bool TxnProcessor::AdmitTxn(Txn* txn, TxnCallback* callback) {
+  txn->callback_ = callback;
+
+  // Atomically assign the txn a new number.
+  txn->unique_id_ = __sync_fetch_and_add(&next_unique_id_, 1);
+
+  // Compute the sets of txns whose sets depend on the data, if the txn can be
+  // restarted should they change before it runs.
+  if (!txn->reconset_.empty()) {
+    if (!recon_supported_) {
+      txn->status_ = ABORTED;
+      FinishTxn(txn);
+      return false;
+    }
+    Reconnoiter(txn);
+  }
+
+  // Read-only txns bypass the scheduler.
+  if (snapshot_reads_ && txn->writeset_.empty() && txn->deltaset_.empty() &&
+      txn->reconset_.empty()) {
+    DispatchTxn(&TxnProcessor::ExecuteReadOnlyTxn, txn);
+    return false;
+  }
+  return true;
 }
 
 Txn* TxnProcessor::GetTxnResult() {
   Txn* txn;
   while (!txn_results_.Pop(&txn)) {
-    // No result yet. Wait a bit before trying again (to reduce contention on
-    // atomic queues).
-    sleep(0.000001);
+    // No result yet. Sleep until one is delivered.
+    int key = results_ready_.PrepareWait();
+    if (txn_results_.Pop(&txn)) {
+      results_ready_.CancelWait();
+      break;
+    }
+    results_ready_.Wait(key);
   }
   return txn;
 }
 
+void TxnProcessor::FinishTxn(Txn* txn) {
+  RecordLatency(txn);
+  ReleaseSlot();
+  if (txn->callback_ != NULL) {
+    txn->callback_->Done(txn);
+  } else {
+    txn_results_.Push(txn);
+    results_ready_.Notify();
+  }
+}
+
+TxnSession::~TxnSession() {
+  // Sleep until the last 'Done()' wakes us.
+  EventCount* idle = &processor_->sessions_idle_;
+  while (outstanding_ != 0) {
+    int key = idle->PrepareWait();
+    if (outstanding_ == 0) {
+      idle->CancelWait();
+      break;
+    }
+    idle->Wait(key);
+  }
+
+  vector<Txn*> results;
+  DrainResults(&results);
+  for (vector<Txn*>::iterator it = results.begin(); it != results.end(); ++it)
+    delete *it;
+}
+
+void TxnSession::SubmitBatch(const vector<Txn*>& txns) {
+  __sync_fetch_and_add(&outstanding_, txns.size());
+  processor_->NewTxnRequests(txns, this);
+}
+
+int TxnSession::DrainResults(vector<Txn*>* results) {
+  return results_.PopAll(results);
+}
+
+void TxnSession::WaitForResults() {
+  while (results_.Size() == 0) {
+    int key = ready_.PrepareWait();
+    if (results_.Size() != 0) {
+      ready_.CancelWait();
+      break;
+    }
+    ready_.Wait(key);
+  }
+}
+
+void TxnSession::Done(Txn* txn) {
+  results_.Push(txn);
+  ready_.Notify();
+
+  // The session may be destroyed as soon as no txns are outstanding, so it
+  // must not be touched afterwards.
+  TxnProcessor* processor = processor_;
+  if (__sync_sub_and_fetch(&outstanding_, 1) == 0)
+    processor->sessions_idle_.NotifyAll();
+}
+
+Txn* TxnFuture::Get() {
+  // Announce the wait, unless the txn has already finished.
+  __sync_val_compare_and_swap(&state_, PENDING, WAITING);
+  while (state_ != DONE)
+    FutexWait(&state_, WAITING);
+  return txn_;
+}
+
+void TxnFuture::Done(Txn* txn) {
+  txn_ = txn;
+
+  // The future may be destroyed as soon as it is DONE, so nothing but the
+  // wakeup may touch it afterwards.
+  if (__sync_lock_test_and_set(&state_, DONE) == WAITING)
+    FutexWake(&state_, INT_MAX);
+}
+
+TxnProcessor::RetryStats TxnProcessor::GetRetryStats() {
+  stats_mutex_.Lock();
+  RetryStats stats = retry_stats_;
+  stats_mutex_.Unlock();
+  return stats;
+}
+
+void TxnProcessor::RecordLatency(Txn* txn) {
+  double latency = (GetTime() - txn->submit_time_) * 1e6;
+  int bucket = 0;
+  if (latency >= 1) {
+    bucket = static_cast<int>(log2(latency) * kLatencyBucketsPerDoubling);
+    bucket = std::min(bucket, kLatencyBuckets - 1);
+  }
+
+  uint64 micros = static_cast<uint64>(latency);
+  int priority = txn->priority_;
+  __sync_fetch_and_add(&latency_buckets_[priority][bucket], 1);
+  __sync_fetch_and_add(&latency_sum_[priority], micros);
+  uint64 max = latency_max_[priority];
+  while (micros > max &&
+         !__sync_bool_compare_and_swap(&latency_max_[priority], max, micros))
+    max = latency_max_[priority];
+}
+
+TxnProcessor::LatencyStats TxnProcessor::GetLatencyStats(
+    TxnPriority priority) {
+  LatencyStats stats;
+  uint64 buckets[kLatencyBuckets];
+  stats.count_ = 0;
+  for (int i = 0; i < kLatencyBuckets; i++) {
+    buckets[i] = latency_buckets_[priority][i];
+    stats.count_ += buckets[i];
+  }
+  stats.mean_ = 0;
+  stats.p50_ = 0;
+  stats.p99_ = 0;
+  stats.max_ = latency_max_[priority] / 1e6;
+  if (stats.count_ == 0)
+    return stats;
+  stats.mean_ = latency_sum_[priority] / 1e6 / stats.count_;
+
+  // Report the upper bound of the bucket holding each percentile.
+  uint64 seen = 0;
+  for (int i = 0; i < kLatencyBuckets; i++) {
+    seen += buckets[i];
+    double bound = exp2(static_cast<double>(i + 1) /
+                        kLatencyBucketsPerDoubling) / 1e6;
+    if (stats.p50_ == 0 && seen * 2 >= stats.count_)
+      stats.p50_ = bound;
+    if (stats.p99_ == 0 && seen * 100 >= stats.count_ * 99) {
+      stats.p99_ = bound;
+      break;
+    }
+  }
+  stats.p50_ = std::min(stats.p50_, stats.max_);
+  stats.p99_ = std::min(stats.p99_, stats.max_);
+  return stats;
+}
+
 void TxnProcessor::RunScheduler() {
   switch (mode_) {
     case SERIAL:                 RunSerialScheduler(); break;
-    case LOCKING:                RunLockingScheduler(); break;
-    case LOCKING_EXCLUSIVE_ONLY: RunLockingScheduler(); break;
+    case LOCKING:
+      RunLockingScheduler<LOCKING, LockManagerB>();
+      break;
+    case LOCKING_EXCLUSIVE_ONLY:
+      RunLockingScheduler<LOCKING_EXCLUSIVE_ONLY, LockManagerA>();
+      break;
+    case LOCKING_ELR:
+      RunLockingScheduler<LOCKING_ELR, LockManagerB>();
+      break;
+    case LOCKING_BATCH:
+      RunLockingScheduler<LOCKING_BATCH, LockManagerB>();
+      break;
+    case LOCKING_IN_PLACE:
+      RunLockingScheduler<LOCKING_IN_PLACE, LockManagerB>();
+      break;
     case OCC:                    RunOCCScheduler(); break;
     case P_OCC:                  RunOCCParallelScheduler(); break;
+    case SILO:                   RunSiloScheduler(); break;
+    case TICTOC:                 RunTicTocScheduler(); break;
+    case SSI:                    RunSSIScheduler(); break;
+    case H_OCC:                  RunHybridOCCScheduler(); break;
+    case ADAPTIVE:               RunAdaptiveScheduler(); break;
+    case HEALING:                RunHealingOCCScheduler(); break;
+    case PARTITIONED:            RunPartitionedScheduler(); break;
+    case LAZY:                   RunLazyScheduler(); break;
   }
 }
 
@@ -77,10 +628,14 @@ void TxnProcessor::RunSerialScheduler() {
   MODE_PRINT(DERROR("Running a Serial Scheduler\n"));
 
   while (tp_.Active()) {
-    // Get next txn request.
-    if (txn_requests_.Pop(&txn)) {
+    // Get the next batch of txn requests, or wait for some to arrive.
+    vector<Txn*> batch;
+    int count = PopTxnRequests(&batch, SCHEDULER_BATCH);
+    for (vector<Txn*>::iterator it = batch.begin(); it != batch.end(); ++it) {
+      txn = *it;
+
       // Execute txn.
-      ExecuteTxn(txn);
+      RunTxnLogic(txn);
 
       // Commit/abort txn according to program logic's commit/abort decision.
       if (txn->Status() == COMPLETED_C) {
@@ -88,86 +643,113 @@ void TxnProcessor::RunSerialScheduler() {
         txn->status_ = COMMITTED;
       } else if (txn->Status() == COMPLETED_A) {
         txn->status_ = ABORTED;
+      } else if (txn->Status() == INCOMPLETE) {
+        // Sets predicted by reconnaissance were stale.
+        RestartReconTxn(txn);
+        continue;
       } else {
         // Invalid TxnStatus!
         DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
       }
 
       // Return result to client.
-      txn_results_.Push(txn);
+      FinishTxn(txn);
     }
+
+    if (count == 0)
+      ParkScheduler();
   }
 }
 
+template <CCMode kMode, class LockManagerT>
 void TxnProcessor::RunLockingScheduler() {
   Txn* txn;
 
   MODE_PRINT(DERROR("Running a Locking Scheduler\n"));
 
   while (tp_.Active()) {
-    // Start processing the next incoming transaction request.
-    if (txn_requests_.Pop(&txn)) {
-      int blocked = 0;
-      // Request read locks.
-      for (set<Key>::iterator it = txn->readset_.begin();
-           it != txn->readset_.end(); ++it) {
-        if (!lm_->ReadLock(txn, *it))
-          blocked++;
-      }
-
-      // Request write locks.
-      for (set<Key>::iterator it = txn->writeset_.begin();
-           it != txn->writeset_.end(); ++it) {
-        if (!lm_->WriteLock(txn, *it))
-          blocked++;
-      }
-
-      // If all read and write locks were immediately acquired, this txn is
-      // ready to be executed.
-      if (blocked == 0)
-        ready_txns_.push_back(txn);
+    // Start processing the next batch of incoming transaction requests. With
+    // LOCKING_BATCH, the batch is reordered so that txns that do not conflict
+    // with one another are admitted together.
+    //
+    // Lock requests are granted in the order they are made, so urgent txns go
+    // first. (Reordering requests already waiting in the lock table could
+    // deadlock, as a txn may have been granted some of its locks.)
+    vector<Txn*> batch;
+    PopTxnRequests(&batch, kMode == LOCKING_BATCH ? REORDER_BATCH_SIZE
+                                                  : SCHEDULER_BATCH);
+    if (kMode == LOCKING_BATCH)
+      ReorderBatch(&batch);
+    int count = batch.size();
+
+    for (vector<Txn*>::iterator it = batch.begin(); it != batch.end(); ++it) {
+      // If all locks were immediately acquired, this txn is ready to be
+      // executed.
+      if (RequestLocks<LockManagerT>(*it))
+        ready_txns_.push_back(*it);
     }
 
-    // Process and commit all transactions that have finished running.
-    while (completed_txns_.Pop(&txn)) {
-      // Release read locks.
-      for (set<Key>::iterator it = txn->readset_.begin();
-           it != txn->readset_.end(); ++it) {
-        lm_->Release(txn, *it);
-      }
-      // Release write locks.
-      for (set<Key>::iterator it = txn->writeset_.begin();
-           it != txn->writeset_.end(); ++it) {
-        lm_->Release(txn, *it);
-      }
+    // Process and commit transactions that have finished running.
+    for (int i = 0; i < SCHEDULER_BATCH && completed_txns_.Pop(&txn); i++) {
+      count++;
 
-      // Commit/abort txn according to program logic's commit/abort decision.
-      if (txn->Status() == COMPLETED_C) {
-        ApplyWrites(txn);
-        txn->status_ = COMMITTED;
-      } else if (txn->Status() == COMPLETED_A) {
+      // Under controlled lock violation, locks are passed on as soon as the
+      // commit/abort decision is made, rather than once it is durable.
+      if (kMode == LOCKING_ELR || txn->Status() == INCOMPLETE)
+        ReleaseLocks<LockManagerT>(txn);
+
+      // Committed txns have already installed their writes (see
+      // 'ExecuteAndCommitTxn()'); abort the others according to program
+      // logic's commit/abort decision.
+      if (txn->Status() == COMPLETED_A) {
         txn->status_ = ABORTED;
-      } else {
+      } else if (txn->Status() == INCOMPLETE) {
+        // Sets predicted by reconnaissance were stale.
+        RestartReconTxn(txn);
+        continue;
+      } else if (txn->Status() != COMMITTED) {
         // Invalid TxnStatus!
         DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
       }
 
+      // Write the outcome to the (simulated) log.
+      log_pending_.push_back(
+          pair<double, Txn*>(GetTime() + log_flush_latency_, txn));
+    }
+
+    // Finish all transactions whose outcome has become durable. The log is
+    // flushed in order, so a txn that saw the effects of another through a
+    // violated lock can never be reported before the txn it depends on.
+    while (!log_pending_.empty() && log_pending_.front().first <= GetTime()) {
+      txn = log_pending_.front().second;
+      log_pending_.pop_front();
+
+      // Release all locks.
+      if (kMode != LOCKING_ELR)
+        ReleaseLocks<LockManagerT>(txn);
+
       // Return result to client.
-      txn_results_.Push(txn);
+      FinishTxn(txn);
     }
 
     // Start executing all transactions that have newly acquired all their
-    // locks.
+    // locks, most urgent first.
+    stable_sort(ready_txns_.begin(), ready_txns_.end(), MoreUrgent);
     while (ready_txns_.size()) {
       // Get next ready txn from the queue.
       txn = ready_txns_.front();
       ready_txns_.pop_front();
 
       // Start txn running in its own thread.
-      tp_.RunTask(new Method<TxnProcessor, void, Txn*>(
-            this,
-            &TxnProcessor::ExecuteTxn,
-            txn));
+      DispatchTxn(&TxnProcessor::ExecuteAndCommitTxn<kMode>, txn);
+    }
+
+    // Wait for work, but no longer than until the next outcome is durable.
+    if (count == 0) {
+      double timeout = SCHEDULER_PARK_TIMEOUT;
+      if (!log_pending_.empty())
+        timeout = std::min(timeout, log_pending_.front().first - GetTime());
+      ParkScheduler(timeout, true);
     }
   }
 }
@@ -187,22 +769,33 @@ void TxnProcessor::RunOCCScheduler() {
   MODE_PRINT(DERROR("Running an OCC Serial Scheduler\n"));
 
   while (tp_.Active()) {
+    int count = 0;                      // Number of requests and txns handled
+
     // Check for transactions waiting in the transaction queue
-    if (txn_requests_.Pop(&txn)) {
+    vector<Txn*> batch;
+    count = PopTxnRequests(&batch, SCHEDULER_BATCH);
+    for (vector<Txn*>::iterator it = batch.begin(); it != batch.end(); ++it) {
+      txn = *it;
       txn->occ_start_time_ = GetTime();  // Record a new Transaction
       MODE_PRINT(DERROR("New transaction %lu starting at %f\n", txn->unique_id_,
                         txn->occ_start_time_));
 
       // Start running the transaction in its own thread
-      tp_.RunTask(new Method<TxnProcessor, void, Txn *>(
-                    this,
-                    &TxnProcessor::ExecuteTxn,
-                    txn));
+      DispatchTxn(&TxnProcessor::ExecuteTxn, txn);
+    }
+
+    // Return transactions whose writes have been installed
+    for (int i = 0; i < SCHEDULER_BATCH && committed_txns_.Pop(&txn); i++) {
+      count++;
+      EndCommit(txn);
+      txn->status_ = COMMITTED;
+      FinishTxn(txn);
     }
 
     // Deal with transactions that have completed execution
-    while (completed_txns_.Pop(&txn)) {
+    for (int i = 0; i < SCHEDULER_BATCH && completed_txns_.Pop(&txn); i++) {
       bool valid = true;                // Boolean to keep track of txn validity
+      count++;
 
       MODE_PRINT(DERROR("Validating transaction %lu\n", txn->unique_id_));
 
@@ -212,7 +805,7 @@ void TxnProcessor::RunOCCScheduler() {
         MODE_PRINT(DERROR("Transaction %lu is requesting an ABORT!\n",
                           txn->unique_id_));
         txn->status_ = ABORTED;
-        txn_results_.Push(txn);
+        FinishTxn(txn);
         continue;
       } else if (txn->Status() != COMPLETED_C) {
         // Invalid Txn Status!
@@ -220,191 +813,1777 @@ void TxnProcessor::RunOCCScheduler() {
       }
 
       // Now we can be sure that the transaction wants to commit. Hence, go
-      // ahead and validate this transaction's reads/writes
-      for (map<Key, Value>::iterator it = txn->reads_.begin();
+      // ahead and validate this transaction's reads/writes. Records that a
+      // validated txn is still writing out count as updated.
+      for (ValueMap::iterator it = txn->reads_.begin();
            it != txn->reads_.end(); ++it) {
-        if (storage_.Timestamp(it->first) > txn->occ_start_time_)  // INVALID!!
+        if (WrittenSince(it->first, txn->occ_start_time_) ||
+            committing_keys_.count(it->first))  // INVALID!!
+          valid = false;
+      }
+
+      // Increments need no reads, but must not be merged into a record while
+      // another txn's update to it is being installed.
+      for (ValueMap::iterator it = txn->deltas_.begin();
+           it != txn->deltas_.end(); ++it) {
+        if (committing_keys_.count(it->first))
           valid = false;
       }
 
-      // If the transaction is valid, commit
+      // If the transaction is valid, have a worker thread install its writes
       if (valid) {  // Could potentially check for Abort here
         MODE_PRINT(DERROR("Transaction %lu is valid!\n", txn->unique_id_));
-        ApplyWrites(txn);
-        txn->status_ = COMMITTED;
-        txn_results_.Push(txn);
+        BeginCommit(txn);
+        DispatchTxn(&TxnProcessor::CommitTxn, txn);
       } else {  // Transaction is not valid, so roll it back
         MODE_PRINT(DERROR("Transaction %lu is invalid!\n", txn->unique_id_));
         (txn->reads_).clear();          // Remove all the reads done by Txn
+        (txn->deltas_).clear();         // ...and all of its increments
         txn->status_ = INCOMPLETE;
+        CountRestart();
         txn_requests_.Push(txn);        // Send Txn back to get re-evaluated
       }
     }
+
+    // Wait for work if there was none
+    if (count == 0)
+      ParkScheduler();
   }
 }
 
-void TxnProcessor::RunOCCParallelScheduler() {
-  // CPSC 438/538:
-  //
-  // Implement this method! Note that implementing OCC with parallel
-  // validation may require modifications to other files, most likely
-  // txn_processor.h and possibly others.
-  //
-  // [For now, run serial scheduler in order to make it through the test
-  // suite]
-
+void TxnProcessor::RunHybridOCCScheduler() {
   Txn *txn;                             // Transaction pointer for current Txn
 
-  MODE_PRINT(DERROR("Running an OCC Parallel Scheduler\n"));
+  MODE_PRINT(DERROR("Running a Hybrid OCC Scheduler\n"));
 
   while (tp_.Active()) {
-    int counter = 0;                     // Counter to keep track of number of
-                                         //  transactions that have been checked
-    pair<Txn*, bool> validation_result;  // Flag for if the transaction is valid
-                                         //  in the post-validation phase
+    int count = 0;                      // Number of txns handled
+
+    // Restart transactions whose backoff has expired
+    double now = GetTime();
+    while (!backoff_txns_.empty() && backoff_txns_.begin()->first <= now) {
+      count++;
+      StartHybridTxn(backoff_txns_.begin()->second);
+      backoff_txns_.erase(backoff_txns_.begin());
+    }
 
     // Check for transactions waiting in the transaction queue
-    if (txn_requests_.Pop(&txn)) {
-      txn->occ_start_time_ = GetTime();  // Record a new Transaction
-      MODE_PRINT(DERROR("New transaction %lu starting at %f\n", txn->unique_id_,
-                        txn->occ_start_time_));
+    vector<Txn*> batch;
+    count += PopTxnRequests(&batch, SCHEDULER_BATCH);
+    for (vector<Txn*>::iterator it = batch.begin(); it != batch.end(); ++it)
+      StartHybridTxn(*it);
 
-      // Start running the transaction in its own thread
-      tp_.RunTask(new Method<TxnProcessor, void, Txn *>(
-                    this,
-                    &TxnProcessor::ExecuteTxn,
-                    txn));
+    // Start running pessimistic transactions that have acquired all locks
+    while (!ready_txns_.empty()) {
+      txn = ready_txns_.front();
+      ready_txns_.pop_front();
+      DispatchTxn(&TxnProcessor::ExecuteTxn, txn);
     }
 
-    while (counter < VALIDATION_MAX &&   // Appropriate number of validations
-           completed_txns_.Pop(&txn)) {  //  and there is a transaction waiting
-      // If the transaction wants to abort, let it. Also check for errors
+    // Deal with transactions that have completed execution
+    while (completed_txns_.Pop(&txn)) {
+      count++;
+      bool locked = (txn->occ_retries_ >= HOCC_MAX_RETRIES);
+
+      // Pessimistic transactions need no validation, but hold locks that
+      // have to be released.
+      if (locked)
+        ReleaseLocks<LockManagerB>(txn);
+
       if (txn->Status() == COMPLETED_A) {
-        MODE_PRINT(DERROR("Transaction %lu is requesting an ABORT!\n",
-                          txn->unique_id_));
         txn->status_ = ABORTED;
-        txn_results_.Push(txn);
+        FinishTxn(txn);
         continue;
       } else if (txn->Status() != COMPLETED_C) {
         // Invalid Txn Status!
         DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
       }
 
-      // The transaction is set on committing. Send it for validation
-      Txn *proxy = new Noop();                       // Create a proxy txn
-      map<Txn*, Txn*> txn_active_set = active_set_;  // Local copy of active set
+      // Validate optimistic transactions. Besides the usual timestamp check,
+      // a transaction is invalid if a pessimistic transaction holds (or is
+      // waiting for) a lock on any record it updates, since that transaction
+      // may already have read the record. Records it only reads need no such
+      // check: the pessimistic transaction simply serializes after it.
+      bool valid = true;
+      if (!locked) {
+        vector<Txn*> owners;
+        for (ValueMap::iterator it = txn->reads_.begin();
+             valid && it != txn->reads_.end(); ++it) {
+          if (WrittenSince(it->first, txn->occ_start_time_))
+            valid = false;
+        }
+        for (KeySet::iterator it = txn->writeset_.begin();
+             valid && it != txn->writeset_.end(); ++it) {
+          if (lm_->Status(*it, &owners) != UNLOCKED)
+            valid = false;
+        }
+        for (KeySet::iterator it = txn->deltaset_.begin();
+             valid && it != txn->deltaset_.end(); ++it) {
+          if (lm_->Status(*it, &owners) != UNLOCKED)
+            valid = false;
+        }
+      }
 
-      txn->CopyTxnInternals(proxy);                      // Populate the proxy
-      active_set_.insert(pair<Txn*, Txn*>(txn, proxy));  // Insert this txn
+      if (valid) {
+        ApplyWrites(txn);
+        txn->status_ = COMMITTED;
+        FinishTxn(txn);
+        continue;
+      }
 
-      MODE_PRINT(DERROR("Sending transaction %lu for validation\n",
-                        txn->unique_id_));
+      // Transaction is not valid, so roll it back and decide how to retry it
+      MODE_PRINT(DERROR("Transaction %lu is invalid!\n", txn->unique_id_));
+      txn->reads_.clear();
+      txn->writes_.clear();
+      txn->deltas_.clear();
+      txn->status_ = INCOMPLETE;
+      txn->occ_retries_++;
+      CountRestart();
+
+      double delay = 0;
+      if (txn->occ_retries_ < HOCC_MAX_RETRIES) {
+        // Exponential backoff with jitter, so that conflicting transactions
+        // do not simply collide again
+        delay = HOCC_BACKOFF_BASE * (1 << (txn->occ_retries_ - 1));
+        if (delay > HOCC_BACKOFF_MAX)
+          delay = HOCC_BACKOFF_MAX;
+        delay = delay / 2 + RandomDouble(delay / 2);
+        backoff_txns_.insert(pair<double, Txn*>(GetTime() + delay, txn));
+      } else {
+        StartHybridTxn(txn);            // Fall back to locking
+      }
 
-      // Validate the transaction in a separate thread
-      tp_.RunTask(new Method<TxnProcessor, void, Txn *, map<Txn*, Txn*> >(
-                    this,
-                    &TxnProcessor::ValidateTxn,
-                    txn,
-                    txn_active_set));
+      stats_mutex_.Lock();
+      retry_stats_.validation_failures_++;
+      if (delay > 0) {
+        retry_stats_.backoffs_++;
+        retry_stats_.backoff_time_ += delay;
+      } else {
+        retry_stats_.fallbacks_++;
+      }
+      if (txn->occ_retries_ > retry_stats_.max_retries_)
+        retry_stats_.max_retries_ = txn->occ_retries_;
+      stats_mutex_.Unlock();
+    }
 
-      ++counter;
+    // Wait for work if there was none, but no longer than the next backoff
+    if (count == 0 && ready_txns_.empty()) {
+      double timeout = SCHEDULER_PARK_TIMEOUT;
+      if (!backoff_txns_.empty())
+        timeout = std::min(timeout, backoff_txns_.begin()->first - GetTime());
+      ParkScheduler(timeout, true);
     }
+  }
+}
 
-    // Reset the counter in order to check post-validated
-    counter = 0;
-    while (counter < POST_VALIDATION_MAX &&   // Appropriate no. post-valid
-           validated_txns_.Pop(&validation_result)) {  // txns present
-      bool valid = validation_result.second;  // Make referencing easier
+void TxnProcessor::StartHybridTxn(Txn* txn) {
+  if (txn->occ_retries_ < HOCC_MAX_RETRIES) {
+    txn->occ_start_time_ = GetTime();
+    DispatchTxn(&TxnProcessor::ExecuteTxn, txn);
+    return;
+  }
 
-      MODE_PRINT(DERROR("Transaction %lu has completed validation with %d\n",
-                        (validation_result.first)->unique_id_, valid));
+  // Request all locks at once, so that pessimistic transactions cannot
+  // deadlock. The transaction is started once it has acquired all of them.
+  if (RequestLocks<LockManagerB>(txn))
+    ready_txns_.push_back(txn);
+}
 
-      txn = validation_result.first;    // Make referencing cleaner
+void TxnProcessor::RunHealingOCCScheduler() {
+  Txn *txn;                             // Transaction pointer for current Txn
 
-      active_set_.erase(txn);           // Remove from active_set
+  MODE_PRINT(DERROR("Running a Healing OCC Scheduler\n"));
+
+  while (tp_.Active()) {
+    int count = 0;                      // Number of requests and txns handled
+
+    // Check for transactions waiting in the transaction queue
+    vector<Txn*> batch;
+    count += PopTxnRequests(&batch, SCHEDULER_BATCH);
+    for (vector<Txn*>::iterator it = batch.begin(); it != batch.end(); ++it) {
+      (*it)->occ_start_time_ = GetTime();
+      DispatchTxn(&TxnProcessor::ExecuteTxn, *it);
+    }
+
+    // Deal with transactions that have completed execution
+    while (completed_txns_.Pop(&txn)) {
+      count++;
+      if (txn->Status() != COMPLETED_A && txn->Status() != COMPLETED_C) {
+        // Invalid Txn Status!
+        DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
+      }
+
+      // Find the reads that have been invalidated by later commits
+      KeySet stale;
+      if (txn->Status() == COMPLETED_C) {
+        for (ValueMap::iterator it = txn->reads_.begin();
+             it != txn->reads_.end(); ++it) {
+          if (WrittenSince(it->first, txn->occ_start_time_))
+            stale.insert(it->first);
+        }
+      }
+
+      // Heal the transaction. Since only this thread writes to storage, the
+      // refreshed values cannot go stale before the transaction commits.
+      if (!stale.empty()) {
+        for (KeySet::iterator it = stale.begin(); it != stale.end(); ++it) {
+          Value result;
+          if (storage_.Read(*it, &result))
+            txn->reads_[*it] = result;
+          else
+            txn->reads_.erase(*it);
+        }
 
-      if (valid) {                      // Transaction was successful
-        txn->status_ = COMMITTED;
-        txn_results_.Push(txn);
-      } else {                          // Transaction was invalid
-        (txn->reads_).clear();          // Remove all the reads done by Txn
         txn->status_ = INCOMPLETE;
-        txn_requests_.Push(txn);
+        txn->Heal(stale);
+        bool healed = (txn->Status() != INCOMPLETE);
+        stats_mutex_.Lock();
+        retry_stats_.validation_failures_++;
+        if (healed)
+          retry_stats_.heals_++;
+        stats_mutex_.Unlock();
+
+        if (!healed) {  // Fall back to re-executing the transaction
+          txn->reads_.clear();
+          txn->writes_.clear();
+          txn->deltas_.clear();
+          txn_requests_.Push(txn);
+          continue;
+        }
       }
 
-      ++counter;
+      // Commit/abort txn according to program logic's commit/abort decision.
+      if (txn->Status() == COMPLETED_C) {
+        ApplyWrites(txn);
+        txn->status_ = COMMITTED;
+      } else {
+        txn->status_ = ABORTED;
+      }
+      FinishTxn(txn);
     }
+
+    // Wait for work if there was none
+    if (count == 0)
+      ParkScheduler();
   }
 }
 
-void TxnProcessor::ExecuteTxn(Txn* txn) {
-  // Read everything in from readset.
-  for (set<Key>::iterator it = txn->readset_.begin();
-       it != txn->readset_.end(); ++it) {
-    // Save each read result iff record exists in storage.
-    Value result;
-    if (storage_.Read(*it, &result))
-      txn->reads_[*it] = result;
-  }
+void TxnProcessor::RunAdaptiveScheduler() {
+  Txn *txn;                             // Transaction pointer for current Txn
 
-  // Also read everything in from writeset.
-  for (set<Key>::iterator it = txn->writeset_.begin();
-       it != txn->writeset_.end(); ++it) {
-    // Save each read result iff record exists in storage.
-    Value result;
-    if (storage_.Read(*it, &result))
-      txn->reads_[*it] = result;
+  MODE_PRINT(DERROR("Running an Adaptive Scheduler\n"));
+
+  adaptive_mode_ = LOCKING;
+  adaptive_next_ = LOCKING;
+  adaptive_in_flight_ = 0;
+  adaptive_window_ = AdaptiveWindow();
+  adaptive_window_.start_ = GetTime();
+
+  while (tp_.Active()) {
+    int count = 0;                      // Number of requests and txns handled
+
+    // Admit new transactions, unless we are draining the old protocol
+    if (adaptive_next_ == adaptive_mode_) {
+      vector<Txn*> batch;
+      count += PopTxnRequests(&batch, SCHEDULER_BATCH);
+      for (vector<Txn*>::iterator it = batch.begin(); it != batch.end(); ++it)
+        AdmitAdaptiveTxn(*it);
+    }
+
+    // Start running transactions that have acquired all their locks
+    while (!ready_txns_.empty()) {
+      txn = ready_txns_.front();
+      ready_txns_.pop_front();
+
+      double now = GetTime();
+      adaptive_window_.lock_wait_ += now - txn->occ_start_time_;
+      txn->occ_start_time_ = now;
+      DispatchTxn(&TxnProcessor::ExecuteTxn, txn);
+    }
+
+    // Deal with transactions that have completed execution
+    while (completed_txns_.Pop(&txn)) {
+      count++;
+      FinishAdaptiveTxn(txn);
+    }
+
+    // Decide which protocol to run next once the window is over
+    if (adaptive_next_ == adaptive_mode_ &&
+        GetTime() >= adaptive_window_.start_ + ADAPT_WINDOW &&
+        adaptive_window_.finished_ >= ADAPT_MIN_SAMPLES) {
+      adaptive_next_ = ChooseAdaptiveMode();
+    }
+
+    // Hand off to the next protocol once the old one is quiescent: no txn
+    // holds locks or awaits validation, so the protocols never overlap
+    if (adaptive_next_ != adaptive_mode_ && adaptive_in_flight_ == 0) {
+      MODE_PRINT(DERROR("Switching from mode %d to mode %d\n",
+                        adaptive_mode_, adaptive_next_));
+      adaptive_mode_ = adaptive_next_;
+      adaptive_window_ = AdaptiveWindow();
+      adaptive_window_.start_ = GetTime();
+      continue;
+    }
+
+    // Wait for work if there was none. Requests held back while draining
+    // the old protocol do not count: only its txns finishing do.
+    if (count == 0 && ready_txns_.empty())
+      ParkScheduler(SCHEDULER_PARK_TIMEOUT, adaptive_next_ == adaptive_mode_);
   }
+}
 
-  // Execute txn's program logic.
+void TxnProcessor::AdmitAdaptiveTxn(Txn* txn) {
+  adaptive_in_flight_++;
+  txn->occ_start_time_ = GetTime();
+
+  if (adaptive_mode_ == SERIAL) {
+    // Run the transaction on the scheduler thread (where it cannot be
+    // suspended), and commit it before the next one reads anything.
+    RunTxnLogic(txn);
+    FinishAdaptiveTxn(txn);
+  } else if (adaptive_mode_ == LOCKING) {
+    if (RequestLocks<LockManagerB>(txn))
+      ready_txns_.push_back(txn);
+  } else {  // adaptive_mode_ == OCC
+    DispatchTxn(&TxnProcessor::ExecuteTxn, txn);
+  }
+}
+
+void TxnProcessor::FinishAdaptiveTxn(Txn* txn) {
+  double now = GetTime();
+  adaptive_window_.executions_++;
+  adaptive_window_.exec_time_ += now - txn->occ_start_time_;
+
+  if (adaptive_mode_ == LOCKING)
+    ReleaseLocks<LockManagerB>(txn);
+
+  if (txn->Status() == COMPLETED_A) {
+    txn->status_ = ABORTED;
+  } else if (txn->Status() == COMPLETED_C) {
+    if (adaptive_mode_ == OCC) {
+      for (ValueMap::iterator it = txn->reads_.begin();
+           it != txn->reads_.end(); ++it) {
+        if (WrittenSince(it->first, txn->occ_start_time_)) {
+          // Invalid, so restart the transaction right away
+          adaptive_window_.restarts_++;
+          CountRestart();
+          txn->reads_.clear();
+          txn->writes_.clear();
+          txn->deltas_.clear();
+          txn->status_ = INCOMPLETE;
+          txn->occ_start_time_ = now;
+          DispatchTxn(&TxnProcessor::ExecuteTxn, txn);
+          return;
+        }
+      }
+    }
+    ApplyWrites(txn);
+    txn->status_ = COMMITTED;
+  } else {
+    // Invalid TxnStatus!
+    DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
+  }
+
+  adaptive_in_flight_--;
+  adaptive_window_.finished_++;
+  FinishTxn(txn);
+}
+
+CCMode TxnProcessor::ChooseAdaptiveMode() {
+  static const CCMode kModes[] = { SERIAL, LOCKING, OCC };
+  static const int kModeCount = sizeof(kModes) / sizeof(kModes[0]);
+  CCMode current = adaptive_mode_;
+  AdaptiveWindow& window = adaptive_window_;
+
+  // Fold the window's throughput into the current protocol's estimate
+  double throughput = window.finished_ / (GetTime() - window.start_);
+  if (adaptive_throughput_[current] == 0)
+    adaptive_throughput_[current] = throughput;
+  else
+    adaptive_throughput_[current] = (adaptive_throughput_[current] +
+                                     throughput) / 2;
+  for (int i = 0; i < kModeCount; i++)
+    adaptive_age_[kModes[i]]++;
+  adaptive_age_[current] = 0;
+
+  double restarts = static_cast<double>(window.restarts_) / window.finished_;
+  double length = window.exec_time_ / window.executions_;
+  double wait_ratio = 0;
+  if (window.lock_wait_ + window.exec_time_ > 0)
+    wait_ratio = window.lock_wait_ / (window.lock_wait_ + window.exec_time_);
+
+  // Start a new window
+  window = AdaptiveWindow();
+  window.start_ = GetTime();
+
+  // If the current protocol looks like a poor fit for the workload, try the
+  // protocol suited to it---unless it was measured recently and did clearly
+  // worse
+  CCMode suggested = current;
+  if (current != SERIAL && length < ADAPT_SHORT_TXN)
+    suggested = SERIAL;
+  else if (current == SERIAL && length > ADAPT_LONG_TXN)
+    suggested = LOCKING;
+  else if (current == OCC && restarts > ADAPT_MAX_RESTARTS)
+    suggested = LOCKING;
+  else if (current == LOCKING && wait_ratio < ADAPT_MIN_WAIT_RATIO)
+    suggested = OCC;
+  if (suggested != current &&
+      (adaptive_age_[suggested] >= ADAPT_PROBE_WINDOWS ||
+       adaptive_throughput_[suggested] == 0 ||
+       adaptive_throughput_[suggested] * (1 + ADAPT_HYSTERESIS) >
+       adaptive_throughput_[current])) {
+    return suggested;
+  }
+
+  // Probe protocols that have not been measured for a while, since the
+  // workload may have changed since. SERIAL is not probed while txns are
+  // long: it runs them on this thread, so the probe would stall the
+  // scheduler until it had gathered enough samples.
+  for (int i = 0; i < kModeCount; i++) {
+    if (kModes[i] == SERIAL && length > ADAPT_LONG_TXN)
+      continue;
+    if (kModes[i] != current &&
+        (adaptive_throughput_[kModes[i]] == 0 ||
+         adaptive_age_[kModes[i]] >= ADAPT_PROBE_WINDOWS)) {
+      return kModes[i];
+    }
+  }
+
+  // Otherwise run the protocol with the best throughput
+  CCMode best = current;
+  for (int i = 0; i < kModeCount; i++) {
+    if (adaptive_throughput_[kModes[i]] >
+        adaptive_throughput_[best] * (1 + ADAPT_HYSTERESIS)) {
+      best = kModes[i];
+    }
+  }
+  return best;
+}
+
+void TxnProcessor::RunPartitionedScheduler() {
+  Txn *txn;
+
+  MODE_PRINT(DERROR("Running a Partitioned Scheduler\n"));
+
+  // Start one worker per partition.
+  for (int p = 0; p < kPartitions; p++) {
+    tp_.RunDedicatedTask(new Method<TxnProcessor, void, int>(
+          this,
+          &TxnProcessor::RunPartition,
+          p));
+  }
+
+  while (tp_.Active()) {
+    vector<Txn*> batch;
+    if (PopTxnRequests(&batch, SCHEDULER_BATCH) == 0) {
+      ParkScheduler();
+      continue;
+    }
+
+    for (vector<Txn*>::iterator next = batch.begin(); next != batch.end();
+         ++next) {
+      txn = *next;
+
+      // Find the partitions spanned by the txn.
+      set<int> partitions;
+      for (KeySet::iterator it = txn->readset_.begin();
+           it != txn->readset_.end(); ++it) {
+        partitions.insert(*it % kPartitions);
+      }
+      for (KeySet::iterator it = txn->writeset_.begin();
+           it != txn->writeset_.end(); ++it) {
+        partitions.insert(*it % kPartitions);
+      }
+      for (KeySet::iterator it = txn->deltaset_.begin();
+           it != txn->deltaset_.end(); ++it) {
+        partitions.insert(*it % kPartitions);
+      }
+
+      PartitionTask task;
+      task.txn_ = txn;
+      task.multi_ = NULL;
+      if (partitions.size() <= 1) {
+        QueuePartitionTask(partitions.empty() ? 0 : *partitions.begin(), task);
+        continue;
+      }
+
+      // Only this thread ever queues txns, so multi-partition txns are queued
+      // in the same order at every partition, and can never deadlock.
+      task.multi_ = new MultiPartitionTxn();
+      task.multi_->txn_ = txn;
+      task.multi_->pending_ = partitions.size();
+      task.multi_->done_ = 0;
+      task.multi_->refs_ = partitions.size();
+      for (set<int>::iterator it = partitions.begin(); it != partitions.end();
+           ++it) {
+        QueuePartitionTask(*it, task);
+      }
+    }
+  }
+}
+
+void TxnProcessor::QueuePartitionTask(int p, const PartitionTask& task) {
+  partition_queues_[p].Push(task);
+  partition_work_[p].Notify();
+}
+
+void TxnProcessor::RunPartition(int p) {
+  PartitionTask task;
+
+  while (tp_.Active()) {
+    if (!partition_queues_[p].Pop(&task)) {
+      // Park until the scheduler queues a task here. The timeout bounds how
+      // long a stopping TxnProcessor waits for the partition to notice.
+      int key = partition_work_[p].PrepareWait();
+      if (partition_queues_[p].Size() != 0) {
+        partition_work_[p].CancelWait();
+        continue;
+      }
+      partition_work_[p].WaitFor(key, SCHEDULER_PARK_TIMEOUT);
+      continue;
+    }
+
+    // Single-partition txns own all of their records.
+    if (task.multi_ == NULL) {
+      ExecuteTxnInline(task.txn_);
+      continue;
+    }
+
+    // Multi-partition txns are executed by the last partition to reach them,
+    // once all others have stopped.
+    MultiPartitionTxn* multi = task.multi_;
+    if (__sync_sub_and_fetch(&multi->pending_, 1) == 0) {
+      ExecuteTxnInline(multi->txn_);
+      __sync_synchronize();
+      multi->done_ = 1;
+      multi->executed_.NotifyAll();
+    } else {
+      while (!multi->done_ && tp_.Active()) {
+        int key = multi->executed_.PrepareWait();
+        if (multi->done_) {
+          multi->executed_.CancelWait();
+          break;
+        }
+        multi->executed_.WaitFor(key, SCHEDULER_PARK_TIMEOUT);
+      }
+    }
+
+    if (__sync_sub_and_fetch(&multi->refs_, 1) == 0)
+      delete multi;
+  }
+}
+
+void TxnProcessor::RunLazyScheduler() {
+  Txn *txn;
+
+  MODE_PRINT(DERROR("Running a Lazy Scheduler\n"));
+
+  while (tp_.Active()) {
+    // With nothing else to do, catch up on the oldest deferred txns, and
+    // wait for work once there are none left.
+    vector<Txn*> batch;
+    if (PopTxnRequests(&batch, SCHEDULER_BATCH) == 0) {
+      if (lazy_txns_.empty())
+        ParkScheduler();
+      for (int i = 0; i < LAZY_IDLE_BATCH && !lazy_txns_.empty(); i++)
+        ForceLazyTxn(lazy_txns_.begin()->first);
+      continue;
+    }
+
+    for (vector<Txn*>::iterator next = batch.begin(); next != batch.end();
+         ++next) {
+      txn = *next;
+
+      // Bound the amount of deferred work.
+      if (lazy_txns_.size() >= LAZY_MAX_DEFERRED)
+        ForceLazyTxn(lazy_txns_.begin()->first);
+
+      uint64 seq = ++lazy_seq_;
+      KeySet keys(txn->readset_);
+      keys.insert(txn->writeset_.begin(), txn->writeset_.end());
+      keys.insert(txn->deltaset_.begin(), txn->deltaset_.end());
+
+      if (txn->NeverAborts()) {
+        // Defer the txn behind the stickies on its records, and leave stickies
+        // of its own.
+        LazyTxn lazy;
+        lazy.txn_ = txn->clone();
+        for (KeySet::iterator it = keys.begin(); it != keys.end(); ++it) {
+          unordered_map<Key, uint64>::iterator sticky =
+              lazy_stickies_.find(*it);
+          if (sticky != lazy_stickies_.end()) {
+            lazy.deps_.push_back(sticky->second);
+            sticky->second = seq;
+          } else {
+            lazy_stickies_[*it] = seq;
+          }
+        }
+        lazy_txns_[seq] = lazy;
+
+        txn->status_ = COMMITTED;
+        FinishTxn(txn);
+        continue;
+      }
+
+      // The txn's outcome depends on what it reads, so run it now, once all
+      // deferred txns that touched its records have been run.
+      for (KeySet::iterator it = keys.begin(); it != keys.end(); ++it) {
+        unordered_map<Key, uint64>::iterator sticky = lazy_stickies_.find(*it);
+        if (sticky != lazy_stickies_.end())
+          ForceLazyTxn(sticky->second);
+      }
+      ExecuteTxnInline(txn);
+    }
+  }
+}
+
+void TxnProcessor::ForceLazyTxn(uint64 seq) {
+  // Collect the deferred txns that must run first. Dependencies always
+  // precede their dependents in the serial order, so running the collected
+  // txns in that order respects them all.
+  set<uint64> needed;
+  vector<uint64> stack(1, seq);
+  while (!stack.empty()) {
+    uint64 next = stack.back();
+    stack.pop_back();
+
+    map<uint64, LazyTxn>::iterator lazy = lazy_txns_.find(next);
+    if (lazy == lazy_txns_.end() || !needed.insert(next).second)
+      continue;
+    stack.insert(stack.end(), lazy->second.deps_.begin(),
+                 lazy->second.deps_.end());
+  }
+
+  for (set<uint64>::iterator it = needed.begin(); it != needed.end(); ++it) {
+    map<uint64, LazyTxn>::iterator lazy = lazy_txns_.find(*it);
+    Txn* txn = lazy->second.txn_;
+    lazy_txns_.erase(lazy);
+
+    RunTxnLogic(txn);
+    if (txn->Status() != COMPLETED_C)
+      DIE("Deferred Txn did not commit: " << txn->Status());
+    ApplyWrites(txn);
+
+    // Remove the stickies that the txn still owns.
+    KeySet keys(txn->readset_);
+    keys.insert(txn->writeset_.begin(), txn->writeset_.end());
+    keys.insert(txn->deltaset_.begin(), txn->deltaset_.end());
+    for (KeySet::iterator key = keys.begin(); key != keys.end(); ++key) {
+      unordered_map<Key, uint64>::iterator sticky = lazy_stickies_.find(*key);
+      if (sticky != lazy_stickies_.end() && sticky->second == *it)
+        lazy_stickies_.erase(sticky);
+    }
+    delete txn;
+  }
+}
+
+void TxnProcessor::RunOCCParallelScheduler() {
+  // CPSC 438/538:
+  //
+  // Implement this method! Note that implementing OCC with parallel
+  // validation may require modifications to other files, most likely
+  // txn_processor.h and possibly others.
+  //
+  // [For now, run serial scheduler in order to make it through the test
+  // suite]
+
+  Txn *txn;                             // Transaction pointer for current Txn
+
+  MODE_PRINT(DERROR("Running an OCC Parallel Scheduler\n"));
+
+  while (tp_.Active()) {
+    int counter = 0;                     // Counter to keep track of number of
+                                         //  transactions that have been checked
+    pair<Txn*, bool> validation_result;  // Flag for if the transaction is valid
+                                         //  in the post-validation phase
+
+    int count = 0;                       // Number of requests and txns handled
+
+    // Check for transactions waiting in the transaction queue
+    vector<Txn*> batch;
+    count = PopTxnRequests(&batch, SCHEDULER_BATCH);
+    for (vector<Txn*>::iterator it = batch.begin(); it != batch.end(); ++it) {
+      txn = *it;
+      txn->occ_start_time_ = GetTime();  // Record a new Transaction
+      MODE_PRINT(DERROR("New transaction %lu starting at %f\n", txn->unique_id_,
+                        txn->occ_start_time_));
+
+      // Start running the transaction in its own thread
+      DispatchTxn(&TxnProcessor::ExecuteTxn, txn);
+    }
+
+    while (counter < VALIDATION_MAX &&   // Appropriate number of validations
+           completed_txns_.Pop(&txn)) {  //  and there is a transaction waiting
+      // If the transaction wants to abort, let it. Also check for errors
+      if (txn->Status() == COMPLETED_A) {
+        MODE_PRINT(DERROR("Transaction %lu is requesting an ABORT!\n",
+                          txn->unique_id_));
+        txn->status_ = ABORTED;
+        FinishTxn(txn);
+        continue;
+      } else if (txn->Status() != COMPLETED_C) {
+        // Invalid Txn Status!
+        DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
+      }
+
+      // The transaction is set on committing. Send it for validation. The
+      // validator enters the active set itself, so nothing is copied here.
+      MODE_PRINT(DERROR("Sending transaction %lu for validation\n",
+                        txn->unique_id_));
+
+      // Validate the transaction in a separate thread
+      DispatchTxn(&TxnProcessor::ValidateTxn, txn);
+
+      ++counter;
+    }
+    count += counter;
+
+    // Reset the counter in order to check post-validated
+    counter = 0;
+    while (counter < POST_VALIDATION_MAX &&   // Appropriate no. post-valid
+           validated_txns_.Pop(&validation_result)) {  // txns present
+      bool valid = validation_result.second;  // Make referencing easier
+
+      MODE_PRINT(DERROR("Transaction %lu has completed validation with %d\n",
+                        (validation_result.first)->unique_id_, valid));
+
+      txn = validation_result.first;    // Make referencing cleaner
+
+      if (valid) {                      // Transaction was successful
+        txn->status_ = COMMITTED;
+        FinishTxn(txn);
+      } else {                          // Transaction was invalid
+        (txn->reads_).clear();          // Remove all the reads done by Txn
+        (txn->deltas_).clear();         // ...and all of its increments
+        txn->status_ = INCOMPLETE;
+        CountRestart();
+        txn_requests_.Push(txn);
+      }
+
+      ++counter;
+    }
+    count += counter;
+
+    // Wait for work if there was none
+    if (count == 0)
+      ParkScheduler();
+  }
+}
+
+void TxnProcessor::RunSiloScheduler() {
+  Txn *txn;
+  double next_epoch_time = GetTime() + SILO_EPOCH_INTERVAL;
+
+  MODE_PRINT(DERROR("Running a Silo Scheduler\n"));
+
+  while (tp_.Active()) {
+    // Advance the global epoch. This is the only shared state that the
+    // scheduler ever writes in this mode.
+    if (GetTime() >= next_epoch_time) {
+      __sync_fetch_and_add(&epoch_, 1);
+      next_epoch_time += SILO_EPOCH_INTERVAL;
+    }
+
+    // Hand new transactions straight to the worker threads, which execute,
+    // validate and commit them without coming back through the scheduler.
+    vector<Txn*> batch;
+    int count = PopTxnRequests(&batch, SCHEDULER_BATCH);
+    for (vector<Txn*>::iterator it = batch.begin(); it != batch.end(); ++it) {
+      txn = *it;
+      DispatchTxn(&TxnProcessor::ExecuteTxnLocally<SILO>, txn);
+    }
+
+    // Wait for work if there was none. Parking times out well before the
+    // next epoch is due.
+    if (count == 0)
+      ParkScheduler();
+  }
+}
+
+void TxnProcessor::RunTicTocScheduler() {
+  Txn *txn;
+
+  MODE_PRINT(DERROR("Running a TicToc Scheduler\n"));
+
+  while (tp_.Active()) {
+    // Hand new transactions straight to the worker threads. Commit timestamps
+    // are computed by the workers from the records each txn accessed, so no
+    // central timestamp allocation is needed.
+    vector<Txn*> batch;
+    int count = PopTxnRequests(&batch, SCHEDULER_BATCH);
+    for (vector<Txn*>::iterator it = batch.begin(); it != batch.end(); ++it) {
+      txn = *it;
+      DispatchTxn(&TxnProcessor::ExecuteTxnLocally<TICTOC>, txn);
+    }
+
+    // Wait for work if there was none.
+    if (count == 0)
+      ParkScheduler();
+  }
+}
+
+void TxnProcessor::RunSSIScheduler() {
+  Txn *txn;
+
+  MODE_PRINT(DERROR("Running an SSI Scheduler\n"));
+
+  while (tp_.Active()) {
+    // Start new transactions against the latest committed snapshot.
+    vector<Txn*> batch;
+    int count = PopTxnRequests(&batch, SCHEDULER_BATCH);
+    for (vector<Txn*>::iterator it = batch.begin(); it != batch.end(); ++it) {
+      txn = *it;
+      txn->snapshot_ts_ = ssi_clock_;
+      RegisterSSI(txn);
+
+      DispatchTxn(&TxnProcessor::ExecuteTxnSnapshot, txn);
+    }
+
+    // Commit or restart transactions that have finished running.
+    for (int i = 0; i < SCHEDULER_BATCH && completed_txns_.Pop(&txn); i++) {
+      count++;
+      UnregisterSSI(txn);
+
+      if (txn->Status() == COMPLETED_A) {
+        txn->status_ = ABORTED;
+        FinishTxn(txn);
+        continue;
+      } else if (txn->Status() != COMPLETED_C) {
+        // Invalid TxnStatus!
+        DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
+      }
+
+      if ((!txn->writeset_.empty() || !txn->deltaset_.empty()) &&
+          !ValidateSSI(txn)) {
+        MODE_PRINT(DERROR("Transaction %lu is invalid!\n", txn->unique_id_));
+        txn->reads_.clear();
+        txn->writes_.clear();
+        txn->deltas_.clear();
+        txn->status_ = INCOMPLETE;
+        CountRestart();
+        txn_requests_.Push(txn);
+        continue;
+      }
+
+      // Read-only txns never abort: they are serialized at their snapshot.
+      // Update txns install new versions at a fresh timestamp. Either way,
+      // the txn's reads are remembered so that concurrent writers can detect
+      // the rw-antidependencies they create.
+      uint64 ts = ++ssi_clock_;
+      uint64 oldest_snapshot =
+          ssi_snapshots_.empty() ? ts : *ssi_snapshots_.begin();
+      for (ValueMap::iterator it = txn->writes_.begin();
+           it != txn->writes_.end(); ++it) {
+        storage_.WriteVersion(it->first, it->second, ts, oldest_snapshot);
+      }
+      for (ValueMap::iterator it = txn->deltas_.begin();
+           it != txn->deltas_.end(); ++it) {
+        Value value = 0;
+        storage_.ReadVersion(it->first, ts, &value);
+        storage_.WriteVersion(it->first, value + it->second, ts,
+                              oldest_snapshot);
+      }
+      for (KeySet::iterator it = txn->readset_.begin();
+           it != txn->readset_.end(); ++it) {
+        ssi_last_read_[*it] = ts;
+        ssi_read_log_.push_back(pair<uint64, Key>(ts, *it));
+      }
+
+      txn->status_ = COMMITTED;
+      FinishTxn(txn);
+    }
+    PruneSSIReads();
+
+    // Wait for work if there was none.
+    if (count == 0)
+      ParkScheduler();
+  }
+}
+
+int TxnProcessor::PopTxnRequests(vector<Txn*>* batch, uint32 max) {
+  Txn* txn;
+  int count = 0;
+  while (batch->size() < max && txn_requests_.Pop(&txn)) {
+    batch->push_back(txn);
+    count++;
+  }
+  stable_sort(batch->end() - count, batch->end(), MoreUrgent);
+  return count;
+}
+
+void TxnProcessor::DispatchTxn(TxnMethod method, Txn* txn) {
+  Task* task = new Method<TxnProcessor, void, Txn*>(this, method, txn);
+  if (txn->priority_ == PRIORITY_HIGH)
+    tp_.RunUrgentTask(task);
+  else if (routing_ == ROUTE_KEY_AFFINITY)
+    tp_.RunTaskOn(HomeQueue(txn), task);
+  else
+    tp_.RunTask(task);
+}
+
+int TxnProcessor::HomeQueue(Txn* txn) {
+  // Count the keys owned by each queue, keeping track of at most
+  // kMaxQueues distinct queues (keys owned by any other queue are ignored).
+  static const int kMaxQueues = 16;
+  int queues[kMaxQueues];
+  int counts[kMaxQueues];
+  int distinct = 0;
+  int best = 0;
+
+  KeySet::const_iterator begins[] = {
+    txn->readset_.begin(), txn->writeset_.begin(), txn->deltaset_.begin()
+  };
+  KeySet::const_iterator ends[] = {
+    txn->readset_.end(), txn->writeset_.end(), txn->deltaset_.end()
+  };
+  for (int s = 0; s < 3; s++) {
+    for (KeySet::const_iterator it = begins[s]; it != ends[s]; ++it) {
+      int queue = *it % tp_.QueueCount();
+      int i = 0;
+      while (i < distinct && queues[i] != queue)
+        i++;
+      if (i == distinct) {
+        if (distinct == kMaxQueues)
+          continue;
+        queues[i] = queue;
+        counts[i] = 0;
+        distinct++;
+      }
+      if (++counts[i] > counts[best])
+        best = i;
+    }
+  }
+  return distinct == 0 ? rand() % tp_.QueueCount() : queues[best];
+}
+
+void TxnProcessor::ParkScheduler() {
+  ParkScheduler(SCHEDULER_PARK_TIMEOUT, true);
+}
+
+void TxnProcessor::ParkScheduler(double timeout, bool accepting) {
+  int key = scheduler_work_.PrepareWait();
+  if ((accepting && txn_requests_.Size() != 0) ||
+      completed_txns_.Size() != 0 || committed_txns_.Size() != 0 ||
+      validated_txns_.Size() != 0 || timeout <= 0) {
+    scheduler_work_.CancelWait();
+    return;
+  }
+  scheduler_work_.WaitFor(key, timeout);
+}
+
+bool TxnProcessor::SuspendTxn(Txn* txn, TxnMethod resume) {
+  if (!txn->Suspended()) {
+    txn->suspendable_ = false;
+    return false;
+  }
+
+  suspended_mutex_.Lock();
+  bool earliest = suspended_txns_.empty() ||
+                  txn->wake_time_ < suspended_txns_.begin()->first;
+  suspended_txns_.insert(pair<double, pair<Txn*, TxnMethod> >(
+        txn->wake_time_, pair<Txn*, TxnMethod>(txn, resume)));
+  suspended_mutex_.Unlock();
+
+  // The waker may be sleeping until a later wake-up time.
+  if (earliest)
+    waker_work_.Notify();
+  return true;
+}
+
+void TxnProcessor::RunWaker() {
+  while (tp_.Active()) {
+    // Announce the wait before looking at the suspended txns, so that a txn
+    // suspended in the meantime is not slept through.
+    int key = waker_work_.PrepareWait();
+
+    vector<pair<Txn*, TxnMethod> > due;
+    double now = GetTime();
+    double timeout = SCHEDULER_PARK_TIMEOUT;
+    suspended_mutex_.Lock();
+    while (!suspended_txns_.empty() &&
+           suspended_txns_.begin()->first <= now) {
+      due.push_back(suspended_txns_.begin()->second);
+      suspended_txns_.erase(suspended_txns_.begin());
+    }
+    if (!suspended_txns_.empty())
+      timeout = std::min(timeout, suspended_txns_.begin()->first - now);
+    suspended_mutex_.Unlock();
+
+    if (due.empty()) {
+      waker_work_.WaitFor(key, timeout);
+      continue;
+    }
+    waker_work_.CancelWait();
+    for (vector<pair<Txn*, TxnMethod> >::iterator it = due.begin();
+         it != due.end(); ++it)
+      DispatchTxn(it->second, it->first);
+  }
+}
+
+void TxnProcessor::ExecuteTxn(Txn* txn) {
+  txn->suspendable_ = true;
+  RunTxnLogic(txn);
+  if (SuspendTxn(txn, &TxnProcessor::ExecuteTxn))
+    return;
+
+  // Hand the txn back to the RunScheduler thread.
+  completed_txns_.Push(txn);
+  scheduler_work_.Notify();
+}
+
+void TxnProcessor::ExecuteReadOnlyTxn(Txn* txn) {
+  // A suspended txn has read its snapshot already.
+  if (!txn->Suspended()) {
+    int tries = 0;
+    while (tries < SNAPSHOT_MAX_RETRIES && !ReadSnapshot(txn)) {
+      txn->reads_.clear();
+      tries++;
+    }
+    if (tries == SNAPSHOT_MAX_RETRIES) {
+      // Writes keep getting installed; let the scheduler deal with the txn.
+      txn_requests_.Push(txn);
+      scheduler_work_.Notify();
+      return;
+    }
+  }
+
+  // Execute txn's program logic, and return the result to the client.
+  txn->suspendable_ = true;
   txn->Run();
+  if (SuspendTxn(txn, &TxnProcessor::ExecuteReadOnlyTxn))
+    return;
+
+  if (txn->Status() == COMPLETED_C) {
+    txn->status_ = COMMITTED;
+  } else if (txn->Status() == COMPLETED_A) {
+    txn->status_ = ABORTED;
+  } else {
+    // Invalid TxnStatus!
+    DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
+  }
+  FinishTxn(txn);
+}
+
+bool TxnProcessor::ReadSnapshot(Txn* txn) {
+  uint64 seq = install_seq_;
+  __sync_synchronize();
+  if (installing_ != 0)
+    return false;
+
+  for (KeySet::iterator it = txn->readset_.begin();
+       it != txn->readset_.end(); ++it) {
+    Value result;
+    if (storage_.Read(*it, &result))
+      txn->reads_[*it] = result;
+  }
+
+  // The reads are consistent iff no txn started or finished installing writes
+  // in the meantime.
+  __sync_synchronize();
+  return installing_ == 0 && install_seq_ == seq;
+}
+
+void TxnProcessor::BeginInstall() {
+  __sync_fetch_and_add(&installing_, 1);
+}
+
+void TxnProcessor::EndInstall() {
+  __sync_fetch_and_add(&install_seq_, 1);
+  __sync_fetch_and_sub(&installing_, 1);
+}
+
+template <CCMode kMode>
+void TxnProcessor::ExecuteAndCommitTxn(Txn* txn) {
+  // Txns updating records in place expose their writes as soon as they run.
+  if (kMode == LOCKING_IN_PLACE && !txn->Suspended())
+    txn->inplace_storage_ = &storage_;
+  txn->suspendable_ = true;
+  RunTxnLogic(txn);
+  if (SuspendTxn(txn, &TxnProcessor::ExecuteAndCommitTxn<kMode>))
+    return;
+
+  // Roll back the in-place writes of a txn that is not going to commit while
+  // it still holds its locks.
+  if (txn->inplace_storage_ != NULL) {
+    if (txn->Status() != COMPLETED_C)
+      UndoWrites(txn);
+    txn->undo_log_.clear();
+    txn->inplace_storage_ = NULL;
+  }
+
+  // The txn still holds all of its locks, so it can install its own writes
+  // instead of leaving that to the RunScheduler thread.
+  if (txn->Status() == COMPLETED_C)
+    ApplyWrites(txn);
 
   // Hand the txn back to the RunScheduler thread.
   completed_txns_.Push(txn);
+  scheduler_work_.Notify();
+}
+
+void TxnProcessor::ExecuteTxnInline(Txn* txn) {
+  RunTxnLogic(txn);
+
+  // Commit/abort txn according to program logic's commit/abort decision.
+  if (txn->Status() == COMPLETED_C) {
+    ApplyWrites(txn);
+    txn->status_ = COMMITTED;
+  } else if (txn->Status() == COMPLETED_A) {
+    txn->status_ = ABORTED;
+  } else {
+    // Invalid TxnStatus!
+    DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
+  }
+
+  // Return result to client.
+  FinishTxn(txn);
+}
+
+void TxnProcessor::RunTxnLogic(Txn* txn) {
+  // A suspended txn picks up where it left off.
+  if (txn->Suspended()) {
+    txn->Run();
+    return;
+  }
+
+  // Read everything in from readset.
+  for (KeySet::iterator it = txn->readset_.begin();
+       it != txn->readset_.end(); ++it) {
+    // Save each read result iff record exists in storage.
+    Value result;
+    if (storage_.Read(*it, &result))
+      txn->reads_[*it] = result;
+  }
+
+  // Also read everything in from writeset.
+  for (KeySet::iterator it = txn->writeset_.begin();
+       it != txn->writeset_.end(); ++it) {
+    // Save each read result iff record exists in storage.
+    Value result;
+    if (storage_.Read(*it, &result))
+      txn->reads_[*it] = result;
+  }
+
+  // Make sure that the data still leads to the sets the txn was scheduled
+  // with. If not, leave the txn INCOMPLETE to have it restarted.
+  if (!txn->reconset_.empty() && !ReconStillValid(txn))
+    return;
+
+  // Execute txn's program logic.
+  txn->Run();
+}
+
+void TxnProcessor::Reconnoiter(Txn* txn) {
+  txn->reads_.clear();
+  for (KeySet::iterator it = txn->reconset_.begin();
+       it != txn->reconset_.end(); ++it) {
+    Value result;
+    if (storage_.Read(*it, &result))
+      txn->reads_[*it] = result;
+  }
+
+  txn->readset_.clear();
+  txn->writeset_.clear();
+  txn->deltaset_.clear();
+  txn->Recon();
+  txn->reads_.clear();
+}
+
+bool TxnProcessor::ReconStillValid(Txn* txn) {
+  KeySet readset;
+  SmallKeySet writeset;
+  SparseKeySet deltaset;
+  readset.swap(txn->readset_);
+  writeset.swap(txn->writeset_);
+  deltaset.swap(txn->deltaset_);
+
+  txn->Recon();
+  bool valid = (txn->readset_ == readset && txn->writeset_ == writeset &&
+                txn->deltaset_ == deltaset);
+
+  txn->readset_.swap(readset);
+  txn->writeset_.swap(writeset);
+  txn->deltaset_.swap(deltaset);
+  return valid;
+}
+
+void TxnProcessor::RestartReconTxn(Txn* txn) {
+  MODE_PRINT(DERROR("Transaction %lu has stale sets!\n", txn->unique_id_));
+  txn->writes_.clear();
+  txn->deltas_.clear();
+  Reconnoiter(txn);
+  CountRestart();
+  txn_requests_.Push(txn);
 }
 
 void TxnProcessor::ApplyWrites(Txn* txn) {
+  BeginInstall();
+
   // Write buffered writes out to storage.
-  for (map<Key, Value>::iterator it = txn->writes_.begin();
+  for (ValueMap::iterator it = txn->writes_.begin();
        it != txn->writes_.end(); ++it) {
     storage_.Write(it->first, it->second);
   }
 
+  // Merge increments into storage.
+  for (ValueMap::iterator it = txn->deltas_.begin();
+       it != txn->deltas_.end(); ++it) {
+    storage_.Add(it->first, it->second);
+  }
+  EndInstall();
+
   // Set status to committed.
   txn->status_ = COMMITTED;
 }
 
-void TxnProcessor::ValidateTxn(Txn *txn, map<Txn*, Txn*> active_set) {
+void TxnProcessor::CommitTxn(Txn* txn) {
+  ApplyWrites(txn);
+
+  // Hand the txn back to the RunScheduler thread.
+  committed_txns_.Push(txn);
+  scheduler_work_.Notify();
+}
+
+void TxnProcessor::BeginCommit(Txn* txn) {
+  // Snapshot reads must not miss the txn until its writes are installed.
+  BeginInstall();
+  for (ValueMap::iterator it = txn->writes_.begin();
+       it != txn->writes_.end(); ++it)
+    committing_keys_[it->first]++;
+  for (ValueMap::iterator it = txn->deltas_.begin();
+       it != txn->deltas_.end(); ++it)
+    committing_keys_[it->first]++;
+}
+
+void TxnProcessor::EndCommit(Txn* txn) {
+  EndInstall();
+  for (ValueMap::iterator it = txn->writes_.begin();
+       it != txn->writes_.end(); ++it) {
+    if (--committing_keys_[it->first] == 0)
+      committing_keys_.erase(it->first);
+  }
+  for (ValueMap::iterator it = txn->deltas_.begin();
+       it != txn->deltas_.end(); ++it) {
+    if (--committing_keys_[it->first] == 0)
+      committing_keys_.erase(it->first);
+  }
+}
+
+void TxnProcessor::UndoWrites(Txn* txn) {
+  // Restore before-images newest first.
+  for (vector<Txn::UndoRecord>::reverse_iterator it = txn->undo_log_.rbegin();
+       it != txn->undo_log_.rend(); ++it) {
+    if (it->existed_)
+      storage_.Write(it->key_, it->value_);
+    else
+      storage_.Delete(it->key_);
+  }
+}
+
+template <class LockManagerT>
+bool TxnProcessor::RequestLocks(Txn* txn) {
+  LockManagerT* lm = static_cast<LockManagerT*>(lm_);
+  int blocked = 0;
+  // Request read locks.
+  for (KeySet::iterator it = txn->readset_.begin();
+       it != txn->readset_.end(); ++it) {
+    if (!lm->LockManagerT::ReadLock(txn, *it))
+      blocked++;
+  }
+
+  // Request write locks.
+  for (KeySet::iterator it = txn->writeset_.begin();
+       it != txn->writeset_.end(); ++it) {
+    if (!lm->LockManagerT::WriteLock(txn, *it))
+      blocked++;
+  }
+
+  // Request increment locks, which other incrementing txns can share.
+  for (KeySet::iterator it = txn->deltaset_.begin();
+       it != txn->deltaset_.end(); ++it) {
+    if (!lm->LockManagerT::IncrementLock(txn, *it))
+      blocked++;
+  }
+
+  return blocked == 0;
+}
+
+bool TxnProcessor::LocksConflict(Txn* a, Txn* b) {
+  // Written records are locked exclusively. Incremented records are only
+  // shared with other txns incrementing them.
+  KeySet a_keys(a->readset_), b_keys(b->readset_);
+  a_keys.insert(a->deltaset_.begin(), a->deltaset_.end());
+  b_keys.insert(b->deltaset_.begin(), b->deltaset_.end());
+
+  return Intersect(a->writeset_, b->writeset_) ||
+         Intersect(a->writeset_, b_keys) ||
+         Intersect(b->writeset_, a_keys) ||
+         Intersect(a->deltaset_, b->readset_) ||
+         Intersect(b->deltaset_, a->readset_);
+}
+
+void TxnProcessor::ReorderBatch(vector<Txn*>* batch) {
+  // Greedily color the conflict graph, in arrival order: each txn gets the
+  // smallest color not used by an earlier txn it conflicts with.
+  vector<int> colors(batch->size());
+  vector<vector<Txn*> > groups;
+  for (uint32 i = 0; i < batch->size(); i++) {
+    set<int> used;
+    for (uint32 j = 0; j < i; j++) {
+      if (LocksConflict((*batch)[i], (*batch)[j]))
+        used.insert(colors[j]);
+    }
+
+    int color = 0;
+    while (used.count(color))
+      color++;
+    colors[i] = color;
+
+    if (groups.size() <= static_cast<uint32>(color))
+      groups.resize(color + 1);
+    groups[color].push_back((*batch)[i]);
+  }
+
+  // Admit the groups one after the other.
+  batch->clear();
+  for (uint32 i = 0; i < groups.size(); i++)
+    batch->insert(batch->end(), groups[i].begin(), groups[i].end());
+}
+
+template <class LockManagerT>
+void TxnProcessor::ReleaseLocks(Txn* txn) {
+  LockManagerT* lm = static_cast<LockManagerT*>(lm_);
+  for (KeySet::iterator it = txn->readset_.begin();
+       it != txn->readset_.end(); ++it) {
+    lm->LockManagerT::Release(txn, *it);
+  }
+  for (KeySet::iterator it = txn->writeset_.begin();
+       it != txn->writeset_.end(); ++it) {
+    lm->LockManagerT::Release(txn, *it);
+  }
+  for (KeySet::iterator it = txn->deltaset_.begin();
+       it != txn->deltaset_.end(); ++it) {
+    lm->LockManagerT::Release(txn, *it);
+  }
+}
+
+void TxnProcessor::ValidateTxn(Txn *txn) {
   bool valid = true;                    // Flag to check validity of Txn
 
-  // Check the read and write sets of the transaction to ensure that nothing
-  // overlapped
-  for (map<Key, Value>::iterator it = txn->reads_.begin();
-       it != txn->reads_.end(); ++it) {
-    if (!valid)                         // Speed up process by breaking earlier
-      break;
-    if (storage_.Timestamp(it->first) > txn->occ_start_time_)  // INVALID!!
+  // Build signatures of everything the txn may have accessed and of
+  // everything it writes.
+  Signature accessed, writes, overwrites, increments;
+  for (KeySet::iterator it = txn->readset_.begin();
+       it != txn->readset_.end(); ++it) {
+    accessed.Add(*it);
+  }
+  for (KeySet::iterator it = txn->writeset_.begin();
+       it != txn->writeset_.end(); ++it) {
+    accessed.Add(*it);
+    writes.Add(*it);
+    overwrites.Add(*it);
+  }
+
+  // Increments conflict with reads and writes, but not with one another, so
+  // they are checked against other txns' overwrites only. (A concurrent
+  // writer may have read the record before the increment was merged.)
+  for (KeySet::iterator it = txn->deltaset_.begin();
+       it != txn->deltaset_.end(); ++it) {
+    writes.Add(*it);
+    increments.Add(*it);
+  }
+
+  // Enter the active set: publish the write signature, then take a sequence
+  // number.
+  ValidationSlot* slot = &validation_slots_[ClaimValidationSlot(txn)];
+  slot->writes_ = writes;
+  slot->overwrites_ = overwrites;
+  __sync_synchronize();
+  uint64 seq = __sync_add_and_fetch(&validation_seq_, 1);
+  slot->seq_ = seq;
+  __sync_synchronize();
+
+  // Check every txn that entered validation before this one and is still
+  // there for a write that may overlap this txn's reads or writes. Txns that
+  // have already left have applied their writes, and are caught by the
+  // timestamp check below instead.
+  for (int i = 0; valid && i < kValidationSlots; i++) {
+    ValidationSlot* other = &validation_slots_[i];
+    if (other == slot)
+      continue;
+
+    // Wait for a validator that has claimed its slot to be sequenced.
+    uint64 other_seq;
+    while (other->taken_ && (other_seq = other->seq_) == 0)
+      sched_yield();
+    if (!other->taken_ || other_seq >= seq)
+      continue;
+
+    __sync_synchronize();
+    bool conflict = accessed.Intersects(other->writes_) ||
+                    increments.Intersects(other->overwrites_);
+    __sync_synchronize();
+    if (conflict && other->seq_ == other_seq)  // There is an intersection
       valid = false;
   }
 
-  // Check the active set for overlapping read or write set
-  for (map<Txn*, Txn*>::iterator it = active_set.begin();
-       it != active_set.end(); ++it) {
-    if (!valid)                         // Speed up process by breaking earlier
-      break;
-    for (map<Key, Value>::iterator it2 = it->second->reads_.begin();
-         it2 != it->second->reads_.end(); ++it2) {
-      if (txn->writeset_.count(it2->first)) {  // There is an intersection
-        valid = false;
-        break;
-      }
-    }
+  // Check the read and write sets of the transaction to ensure that nothing
+  // has been written since it started.
+  for (KeySet::iterator it = txn->readset_.begin();
+       valid && it != txn->readset_.end(); ++it) {
+    if (WrittenSince(*it, txn->occ_start_time_))  // INVALID!!
+      valid = false;
+  }
+  for (KeySet::iterator it = txn->writeset_.begin();
+       valid && it != txn->writeset_.end(); ++it) {
+    if (WrittenSince(*it, txn->occ_start_time_))  // INVALID!!
+      valid = false;
   }
 
   // If the transaction is valid, perform the writes for the transaction
   if (valid)
     ApplyWrites(txn);
 
+  // Leave the active set.
+  __sync_synchronize();
+  slot->seq_ = 0;
+  __sync_synchronize();
+  slot->taken_ = 0;
+
   // Set all transactions to 'valid'
   validated_txns_.Push(pair<Txn*, bool>(txn, valid));
+  scheduler_work_.Notify();
+}
+
+int TxnProcessor::ClaimValidationSlot(Txn* txn) {
+  // Start looking at a txn-specific slot to spread validators out.
+  int i = txn->unique_id_ % kValidationSlots;
+  while (validation_slots_[i].taken_ ||
+         !__sync_bool_compare_and_swap(&validation_slots_[i].taken_, 0, 1)) {
+    i = (i + 1) % kValidationSlots;
+    if (i == 0)
+      sched_yield();
+  }
+  return i;
+}
+
+void TxnProcessor::ReadVersioned(Txn* txn, const Key& key,
+                                 volatile uint64* word, uint64 lock_bit) {
+  uint64 before, after;
+  Value result;
+  bool found;
+
+  // Retry until the value was read while its version word was unlocked and
+  // unchanged, i.e. no commit to the record overlapped the read.
+  do {
+    while ((before = *word) & lock_bit)
+      sched_yield();
+    __sync_synchronize();
+    found = storage_.Read(key, &result);
+    __sync_synchronize();
+    after = *word;
+  } while (before != after);
+
+  if (found)
+    txn->reads_[key] = result;
+  txn->read_versions_[key] = before;
+}
+
+template <CCMode kMode>
+void TxnProcessor::ExecuteTxnLocally(Txn* txn) {
+  // A suspended txn picks up where it left off.
+  if (!txn->Suspended()) {
+    // Read everything in from readset and writeset, recording one version
+    // per record.
+    txn->read_versions_.reserve(txn->readset_.size() +
+                                txn->writeset_.size());
+    for (KeySet::iterator it = txn->readset_.begin();
+         it != txn->readset_.end(); ++it) {
+      if (kMode == SILO)
+        ReadVersioned(txn, *it, storage_.TidWord(*it), TID_LOCK_BIT);
+      else
+        ReadVersioned(txn, *it, storage_.TsWord(*it), TS_LOCK_BIT);
+    }
+    for (KeySet::iterator it = txn->writeset_.begin();
+         it != txn->writeset_.end(); ++it) {
+      if (kMode == SILO)
+        ReadVersioned(txn, *it, storage_.TidWord(*it), TID_LOCK_BIT);
+      else
+        ReadVersioned(txn, *it, storage_.TsWord(*it), TS_LOCK_BIT);
+    }
+  }
+
+  // Execute txn's program logic.
+  txn->suspendable_ = true;
+  txn->Run();
+  if (SuspendTxn(txn, &TxnProcessor::ExecuteTxnLocally<kMode>))
+    return;
+
+  if (txn->Status() == COMPLETED_A) {
+    txn->status_ = ABORTED;
+  } else if (txn->Status() != COMPLETED_C) {
+    // Invalid TxnStatus!
+    DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
+  } else if (!(kMode == SILO ? SiloCommit(txn) : TicTocCommit(txn))) {
+    // Validation failed. Completely restart the transaction.
+    MODE_PRINT(DERROR("Transaction %lu is invalid!\n", txn->unique_id_));
+    txn->reads_.clear();
+    txn->writes_.clear();
+    txn->deltas_.clear();
+    txn->read_versions_.clear();
+    txn->status_ = INCOMPLETE;
+    CountRestart();
+    txn_requests_.Push(txn);
+    scheduler_work_.Notify();
+    return;
+  }
+
+  // Return result to client.
+  FinishTxn(txn);
+}
+
+bool TxnProcessor::SiloCommit(Txn* txn) {
+  // Phase 1: lock the TID words covering the write set and the delta set.
+  vector<volatile uint64*> locked;
+  for (KeySet::iterator it = txn->writeset_.begin();
+       it != txn->writeset_.end(); ++it) {
+    locked.push_back(storage_.TidWord(*it));
+  }
+  for (KeySet::iterator it = txn->deltaset_.begin();
+       it != txn->deltaset_.end(); ++it) {
+    locked.push_back(storage_.TidWord(*it));
+  }
+  LockWords(&locked, TID_LOCK_BIT);
+
+  // Serialization point: snapshot the global epoch.
+  __sync_synchronize();
+  uint64 epoch = epoch_;
+  __sync_synchronize();
+
+  // Phase 2: validate the read set. Every record read must still carry the TID
+  // observed when it was read, and must not be locked by another committer.
+  // Records that are only incremented were never read, so need no validation;
+  // the new TID just has to be larger than theirs.
+  bool valid = true;
+  uint64 max_tid = silo_last_tid;
+  for (vector<volatile uint64*>::iterator it = locked.begin();
+       it != locked.end(); ++it) {
+    max_tid = std::max(max_tid, static_cast<uint64>(**it & ~TID_LOCK_BIT));
+  }
+  for (ValueMap::iterator it = txn->read_versions_.begin();
+       it != txn->read_versions_.end(); ++it) {
+    volatile uint64* word = storage_.TidWord(it->first);
+    uint64 current = *word;
+    if ((current & ~TID_LOCK_BIT) != it->second ||
+        ((current & TID_LOCK_BIT) &&
+         !binary_search(locked.begin(), locked.end(), word))) {
+      valid = false;
+      break;
+    }
+    max_tid = std::max(max_tid, it->second);
+  }
+
+  if (!valid) {
+    UnlockWords(locked, TID_LOCK_BIT);
+    return false;
+  }
+
+  // Phase 3: generate a TID larger than any TID observed (and than this
+  // worker's previous TID), within the current epoch, then install the writes
+  // and release the locks by publishing the new TID.
+  uint64 tid = max_tid + TID_SEQ_STEP;
+  if ((tid >> TID_EPOCH_SHIFT) < epoch)
+    tid = epoch << TID_EPOCH_SHIFT;
+  silo_last_tid = tid;
+
+  ApplyWrites(txn);
+  __sync_synchronize();
+  for (vector<volatile uint64*>::iterator it = locked.begin();
+       it != locked.end(); ++it) {
+    **it = tid;
+  }
+  return true;
+}
+
+bool TxnProcessor::TicTocCommit(Txn* txn) {
+  // Lock the timestamp words covering the write set and the delta set.
+  // Records that are only incremented were never read, so are ordered by the
+  // commit timestamp computed below but need no validation.
+  vector<volatile uint64*> locked;
+  for (KeySet::iterator it = txn->writeset_.begin();
+       it != txn->writeset_.end(); ++it) {
+    locked.push_back(storage_.TsWord(*it));
+  }
+  for (KeySet::iterator it = txn->deltaset_.begin();
+       it != txn->deltaset_.end(); ++it) {
+    locked.push_back(storage_.TsWord(*it));
+  }
+  LockWords(&locked, TS_LOCK_BIT);
+
+  // Compute the commit timestamp: the txn must be ordered after the current
+  // version of every record it writes (and after every read of it), and no
+  // earlier than the versions it read.
+  uint64 commit_ts = 0;
+  for (vector<volatile uint64*>::iterator it = locked.begin();
+       it != locked.end(); ++it) {
+    commit_ts = std::max(commit_ts, TsRts(**it) + 1);
+  }
+  for (ValueMap::iterator it = txn->read_versions_.begin();
+       it != txn->read_versions_.end(); ++it) {
+    commit_ts = std::max(commit_ts, TsWts(it->second));
+  }
+
+  // Validate the read set. Each version read must still be current at
+  // 'commit_ts'; where its read timestamp falls short, try to extend it.
+  for (ValueMap::iterator it = txn->read_versions_.begin();
+       it != txn->read_versions_.end(); ++it) {
+    if (TsRts(it->second) >= commit_ts)
+      continue;
+
+    volatile uint64* word = storage_.TsWord(it->first);
+    bool mine = binary_search(locked.begin(), locked.end(), word);
+    while (true) {
+      uint64 current = *word;
+
+      // The record was overwritten since it was read, or is about to be by a
+      // commit that could be ordered before ours. INVALID!!
+      if (TsWts(current) != TsWts(it->second) ||
+          (!mine && (current & TS_LOCK_BIT) && TsRts(current) <= commit_ts)) {
+        UnlockWords(locked, TS_LOCK_BIT);
+        return false;
+      }
+
+      // Records we are about to overwrite need no extension, and neither do
+      // records someone else has already extended far enough.
+      if (mine || TsRts(current) >= commit_ts)
+        break;
+
+      uint64 extended = MakeTsWord(TsWts(current), commit_ts);
+      if (__sync_bool_compare_and_swap(word, current, extended))
+        break;
+    }
+  }
+
+  // Install the writes, then release the locks by publishing the new
+  // timestamps.
+  ApplyWrites(txn);
+  __sync_synchronize();
+  for (vector<volatile uint64*>::iterator it = locked.begin();
+       it != locked.end(); ++it) {
+    **it = MakeTsWord(commit_ts, commit_ts);
+  }
+  return true;
+}
+
+void TxnProcessor::ExecuteTxnSnapshot(Txn* txn) {
+  // A suspended txn picks up where it left off.
+  if (!txn->Suspended()) {
+    // Read everything in from readset and writeset as of the txn's snapshot.
+    for (KeySet::iterator it = txn->readset_.begin();
+         it != txn->readset_.end(); ++it) {
+      Value result;
+      if (storage_.ReadVersion(*it, txn->snapshot_ts_, &result))
+        txn->reads_[*it] = result;
+    }
+    for (KeySet::iterator it = txn->writeset_.begin();
+         it != txn->writeset_.end(); ++it) {
+      Value result;
+      if (storage_.ReadVersion(*it, txn->snapshot_ts_, &result))
+        txn->reads_[*it] = result;
+    }
+  }
+
+  // Execute txn's program logic.
+  txn->suspendable_ = true;
+  txn->Run();
+  if (SuspendTxn(txn, &TxnProcessor::ExecuteTxnSnapshot))
+    return;
+
+  // Hand the txn back to the RunScheduler thread.
+  completed_txns_.Push(txn);
+  scheduler_work_.Notify();
+}
+
+void TxnProcessor::RegisterSSI(Txn* txn) {
+  ssi_snapshots_.insert(txn->snapshot_ts_);
+  for (KeySet::iterator it = txn->readset_.begin();
+       it != txn->readset_.end(); ++it) {
+    ssi_active_readers_[*it]++;
+  }
+}
+
+void TxnProcessor::UnregisterSSI(Txn* txn) {
+  ssi_snapshots_.erase(ssi_snapshots_.find(txn->snapshot_ts_));
+  for (KeySet::iterator it = txn->readset_.begin();
+       it != txn->readset_.end(); ++it) {
+    if (--ssi_active_readers_[*it] == 0)
+      ssi_active_readers_.erase(*it);
+  }
+}
+
+void TxnProcessor::PruneSSIReads() {
+  uint64 oldest_snapshot =
+      ssi_snapshots_.empty() ? ssi_clock_ : *ssi_snapshots_.begin();
+  while (!ssi_read_log_.empty() &&
+         ssi_read_log_.front().first <= oldest_snapshot) {
+    // Keys read again since keep their newer entry.
+    unordered_map<Key, uint64>::iterator last_read =
+        ssi_last_read_.find(ssi_read_log_.front().second);
+    if (last_read->second == ssi_read_log_.front().first)
+      ssi_last_read_.erase(last_read);
+    ssi_read_log_.pop_front();
+  }
+}
+
+bool TxnProcessor::ValidateSSI(Txn* txn) {
+  // First-committer-wins: a concurrent txn has already committed a write to
+  // something this txn writes.
+  for (KeySet::iterator it = txn->writeset_.begin();
+       it != txn->writeset_.end(); ++it) {
+    if (storage_.LatestVersion(*it) > txn->snapshot_ts_)
+      return false;
+  }
+
+  // Increments commute, so they are exempt from first-committer-wins. They do
+  // however overwrite the versions seen by concurrent readers, and are
+  // treated like writes below.
+
+  // Outgoing rw-antidependency: something this txn read has since been
+  // overwritten by a concurrent txn that committed first.
+  bool out_conflict = false;
+  for (KeySet::iterator it = txn->readset_.begin();
+       it != txn->readset_.end(); ++it) {
+    if (storage_.LatestVersion(*it) > txn->snapshot_ts_) {
+      out_conflict = true;
+      break;
+    }
+  }
+  if (!out_conflict)
+    return true;
+
+  // Incoming rw-antidependency: a concurrent txn (still active, or finished
+  // after this txn started) reads something this txn writes, and so sees the
+  // version this txn is about to replace. Since readsets are declared up
+  // front, active readers are caught even before they perform the read; this
+  // is what guarantees that read-only txns never have to abort.
+  for (KeySet::iterator it = txn->writeset_.begin();
+       it != txn->writeset_.end(); ++it) {
+    if (ssi_active_readers_.count(*it))
+      return false;
+    unordered_map<Key, uint64>::iterator last_read = ssi_last_read_.find(*it);
+    if (last_read != ssi_last_read_.end() &&
+        last_read->second > txn->snapshot_ts_)
+      return false;
+  }
+  for (KeySet::iterator it = txn->deltaset_.begin();
+       it != txn->deltaset_.end(); ++it) {
+    if (ssi_active_readers_.count(*it))
+      return false;
+    unordered_map<Key, uint64>::iterator last_read = ssi_last_read_.find(*it);
+    if (last_read != ssi_last_read_.end() &&
+        last_read->second > txn->snapshot_ts_)
+      return false;
+  }
+  return true;
 }
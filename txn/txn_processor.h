@@ -4,43 +4,142 @@
 #ifndef _TXN_PROCESSOR_H_
 #define _TXN_PROCESSOR_H_
 
+#include <tr1/unordered_map>
 #include <utility>
 #include <deque>
 #include <map>
 #include <string>
 #include <set>
+#include <vector>
 
 #include "txn/common.h"
 #include "txn/lock_manager.h"
+#include "txn/signature.h"
 #include "txn/storage.h"
 #include "txn/txn.h"
 #include "utils/atomic.h"
+#include "utils/eventcount.h"
 #include "utils/static_thread_pool.h"
 #include "utils/mutex.h"
 
 using std::deque;
 using std::map;
+using std::multimap;
+using std::multiset;
 using std::string;
 using std::pair;
+using std::tr1::unordered_map;
 
-// The TxnProcessor supports five different execution modes, corresponding to
-// the four parts of assignment 2, plus a simple serial (non-concurrent) mode.
+// The TxnProcessor supports several different execution modes: the four parts
+// of assignment 2, a simple serial (non-concurrent) mode, and a number of
+// additional concurrency control schemes.
 enum CCMode {
   SERIAL = 0,                  // Serial transaction execution (no concurrency)
   LOCKING_EXCLUSIVE_ONLY = 1,  // Part 1A
   LOCKING = 2,                 // Part 1B
   OCC = 3,                     // Part 2
   P_OCC = 4,                   // Part 3
+  SILO = 5,                    // Silo-style OCC with decentralised validation
+  TICTOC = 6,                  // TicToc timestamp-ordering OCC
+  SSI = 7,                     // Serializable snapshot isolation
+  H_OCC = 8,                   // OCC falling back to locking for hot txns
+  ADAPTIVE = 9,                // Switches among SERIAL, LOCKING and OCC
+  HEALING = 10,                // OCC that heals, rather than restarts, txns
+  PARTITIONED = 11,            // H-Store-style partitioned serial execution
+  // LAZY reports txns that can never abort as COMMITTED as soon as they are
+  // ordered, before they have run, so their 'reads_' and 'writes_' come back
+  // empty. All txn logic, deferred or not, runs on the scheduler thread.
+  LAZY = 12,                   // Serial execution with lazy evaluation
+  LOCKING_ELR = 13,            // Part 1B with early lock release
+  LOCKING_BATCH = 14,          // Part 1B with conflict-aware batch admission
+  LOCKING_IN_PLACE = 15,       // Part 1B with in-place writes and undo log
 };
 
 // Returns a human-readable string naming of the providing mode.
 string ModeToString(CCMode mode);
 
+// Receives the result of a txn submitted with 'NewTxnRequest(txn, callback)'.
+class TxnCallback {
+ public:
+  virtual ~TxnCallback() {}
+
+  // Called exactly once, on the thread that finishes the txn, with the
+  // COMMITTED or ABORTED txn. Ownership of '*txn' passes to the callback.
+  // Should be quick, as it holds up that thread.
+  virtual void Done(Txn* txn) = 0;
+};
+
+// Callback that lets a client wait for the result of one particular txn.
+class TxnFuture : public TxnCallback {
+ public:
+  TxnFuture() : txn_(NULL), state_(PENDING) {}
+
+  // Returns true if the txn has finished.
+  bool Ready() { return state_ == DONE; }
+
+  // Blocks until the txn has finished, then returns it. The caller takes
+  // ownership of the returned Txn.
+  Txn* Get();
+
+  virtual void Done(Txn* txn);
+
+ private:
+  // Values of 'state_', which doubles as futex word.
+  enum { PENDING = 0, WAITING = 1, DONE = 2 };
+
+  Txn* txn_;
+  volatile int state_;
+};
+
+// How the scheduler picks the worker queue that runs a txn.
+enum TaskRouting {
+  ROUTE_RANDOM = 0,        // Any queue, chosen at random
+  ROUTE_KEY_AFFINITY = 1,  // The queue owning most of the txn's keys
+};
+
+// Layout of the worker threads that execute txns, and other settings of the
+// environment they run in. The scheduler and other long-running loops get
+// threads of their own on top of these.
+struct ExecutorOptions {
+  ExecutorOptions()
+      : thread_count_(16), queue_count_(4), routing_(ROUTE_RANDOM),
+        admission_limit_(kAdaptiveAdmission), log_flush_latency_(0) {}
+
+  // Returns a thread-per-core layout: one worker thread pinned to each CPU
+  // the process may run on, each with a queue of its own, and txns routed by
+  // key affinity.
+  static ExecutorOptions ThreadPerCore();
+
+  // Number of worker threads, and of queues they share.
+  int thread_count_;
+  int queue_count_;
+
+  // CPUs the worker threads are pinned to, round robin (unpinned if empty).
+  vector<int> cpus_;
+
+  // Routing of txns to queues. Under ROUTE_KEY_AFFINITY, queue i owns the
+  // keys k with k % queue_count_ == i.
+  TaskRouting routing_;
+
+  // Limit on the number of txns in flight (see
+  // 'TxnProcessor::NewTxnRequest()'): kAdaptiveAdmission adapts it to the
+  // workload, kUnlimitedAdmission turns admission control off, and a positive
+  // value fixes the limit.
+  static const int kAdaptiveAdmission = 0;
+  static const int kUnlimitedAdmission = -1;
+  int admission_limit_;
+
+  // Time (in seconds) it takes for a commit record to become durable in the
+  // simulated log of the locking modes. 0 disables the simulation.
+  double log_flush_latency_;
+};
+
 class TxnProcessor {
  public:
   // The TxnProcessor's constructor starts the TxnProcessor running in the
-  // background.
-  explicit TxnProcessor(CCMode mode);
+  // background, with worker threads laid out according to 'options'.
+  explicit TxnProcessor(CCMode mode,
+                        const ExecutorOptions& options = ExecutorOptions());
 
   // The TxnProcessor's destructor stops all background threads and deallocates
   // all objects currently owned by the TxnProcessor, except for Txn objects.
@@ -48,20 +147,86 @@ class TxnProcessor {
 
   // Registers a new txn request to be executed by the TxnProcessor.
   // Ownership of '*txn' is transfered to the TxnProcessor.
+  //
+  // The number of txns in flight (registered but not finished) is bounded by
+  // an admission limit, which by default adapts to the workload to stay near
+  // peak throughput (see 'AdaptAdmissionLimit()' and
+  // 'ExecutorOptions::admission_limit_'). At the limit, 'NewTxnRequest()'
+  // blocks until some txn has finished. PRIORITY_HIGH txns are never held
+  // back (but do count as in flight).
   void NewTxnRequest(Txn* txn);
 
-  // Returns a pointer to the next COMMITTED or ABORTED Txn. The caller takes
-  // ownership of the returned Txn.
+  // Same as above, but the result is handed to 'callback' instead of being
+  // returned by 'GetTxnResult()'. The caller keeps ownership of '*callback',
+  // which must stay alive until it has been called.
+  void NewTxnRequest(Txn* txn, TxnCallback* callback);
+
+  // Same as above, but returns false instead of blocking if the admission
+  // limit has been reached (in which case ownership of '*txn' stays with the
+  // caller). Callbacks that submit further txns must use this, as blocking
+  // would stall the thread that finishes txns.
+  bool TryNewTxnRequest(Txn* txn, TxnCallback* callback);
+
+  // Registers all of 'txns' at once, handing their results to 'callback' (or
+  // to 'GetTxnResult()' if 'callback' is NULL), as 'NewTxnRequest()' does.
+  void NewTxnRequests(const vector<Txn*>& txns, TxnCallback* callback);
+
+  // Returns a pointer to the next COMMITTED or ABORTED Txn, blocking until
+  // there is one. The caller takes ownership of the returned Txn.
   Txn* GetTxnResult();
 
+  // Statistics on OCC validation failures and retries (maintained by H_OCC
+  // and HEALING).
+  struct RetryStats {
+    uint64 validation_failures_;  // Number of failed validations.
+    uint64 heals_;                // Number of txns healed after a failure.
+    uint64 fallbacks_;            // Number of txns re-run under locks.
+    uint64 backoffs_;             // Number of retries delayed by a backoff.
+    double backoff_time_;         // Total time (in seconds) spent backing off.
+    int max_retries_;             // Most failed validations by a single txn.
+  };
+
+  // Returns a snapshot of the current retry statistics.
+  RetryStats GetRetryStats();
+
+  // Returns the current admission limit (INT_MAX if there is none).
+  int AdmissionLimit() { return admission_limit_; }
+
+  // Statistics on the latency of txns from submission to result.
+  struct LatencyStats {
+    uint64 count_;  // Number of txns finished.
+    double mean_;   // Mean latency (in seconds).
+    double p50_;    // Median latency (in seconds).
+    double p99_;    // 99th percentile latency (in seconds).
+    double max_;    // Maximum latency (in seconds).
+  };
+
+  // Returns the latency statistics for txns of priority class 'priority'.
+  // Percentiles are accurate to within 10%.
+  LatencyStats GetLatencyStats(TxnPriority priority);
+
  private:
-  // Main loop implementing all concurrency control/thread scheduling.
+  friend class TxnSession;
+
+  // Main loop implementing all concurrency control/thread scheduling. Picks
+  // the scheduler for 'mode_'. The per-txn paths of the locking modes and of
+  // SILO/TICTOC are member templates on the mode (see below), so they do not
+  // look at 'mode_' again. The TxnProcessor itself is not a template, and is
+  // still configured at run time.
   void RunScheduler();
 
   // Serial version of scheduler.
   void RunSerialScheduler();
 
-  // Locking version of scheduler.
+  // Locking version of scheduler. A txn's outcome is only returned to the
+  // client once it is durable in a simulated commit log (see
+  // 'log_flush_latency_'); txns keep their locks until then, except under
+  // LOCKING_ELR.
+  //
+  // Instantiated for each of the locking modes, with 'lm_' known to be a
+  // 'LockManagerT', so that lock calls are not virtual. (They are not
+  // inlined, as the lock managers are defined in lock_manager.cc.)
+  template <CCMode kMode, class LockManagerT>
   void RunLockingScheduler();
 
   // OCC version of scheduler.
@@ -70,44 +235,364 @@ class TxnProcessor {
   // OCC version of scheduler with parallel validation.
   void RunOCCParallelScheduler();
 
+  // Hybrid OCC version of scheduler. Txns that fail validation are retried
+  // after an exponential backoff, and txns that have failed validation
+  // HOCC_MAX_RETRIES times are re-run pessimistically under locks.
+  void RunHybridOCCScheduler();
+
+  // Starts (or restarts) 'txn' under H_OCC: optimistically if it has failed
+  // validation fewer than HOCC_MAX_RETRIES times, else by requesting locks on
+  // its readset and writeset.
+  void StartHybridTxn(Txn* txn);
+
+  // Healing OCC version of scheduler. A txn that fails validation has its
+  // stale reads refreshed and only the operations that depend on them redone
+  // (see 'Txn::Heal()'), and is then committed without re-execution.
+  void RunHealingOCCScheduler();
+
+  // Adaptive version of scheduler. Runs one of SERIAL, LOCKING and OCC at a
+  // time, and periodically switches between them based on the throughput,
+  // abort rate, lock wait time and txn length observed over a sliding window.
+  // A switch only takes effect once every txn admitted under the old protocol
+  // has finished.
+  void RunAdaptiveScheduler();
+
+  // Starts 'txn' under the adaptive scheduler's current protocol.
+  void AdmitAdaptiveTxn(Txn* txn);
+
+  // Commits, aborts or (for OCC) restarts a txn that has finished executing
+  // under the adaptive scheduler.
+  void FinishAdaptiveTxn(Txn* txn);
+
+  // Closes the current observation window and returns the protocol that the
+  // adaptive scheduler should use next.
+  CCMode ChooseAdaptiveMode();
+
+  // Partitioned version of scheduler. The keyspace is hash-partitioned, and
+  // each txn is routed to the partition(s) owning the keys it accesses (see
+  // 'RunPartition()').
+  void RunPartitionedScheduler();
+
+  // Main loop of the worker owning partition 'p'. Runs the partition's
+  // single-partition txns serially, without any locks or latches. A
+  // multi-partition txn is queued at every partition it spans; each of them
+  // stops when it reaches the txn, and the last one to do so executes it,
+  // after which they all resume. Idle partitions (and partitions waiting for
+  // a multi-partition txn to be executed) are parked rather than spinning.
+  void RunPartition(int p);
+
+  // Lazy version of scheduler. Txns are serialized in arrival order, as in
+  // SERIAL, but the execution of txns that never abort is deferred: they are
+  // reported committed right away, and only leave a 'sticky' on each record
+  // they access. A deferred txn is run once a later txn needs one of those
+  // records, or once the scheduler has nothing else to do.
+  void RunLazyScheduler();
+
+  // Runs deferred txn 'seq', after every deferred txn it depends on.
+  void ForceLazyTxn(uint64 seq);
+
+  // Silo version of scheduler. Only dispatches txns and advances the global
+  // epoch; all validation and commit work is done by the worker threads.
+  void RunSiloScheduler();
+
+  // TicToc version of scheduler. Only dispatches txns; all validation and
+  // commit work is done by the worker threads.
+  void RunTicTocScheduler();
+
+  // Serializable snapshot isolation version of scheduler.
+  void RunSSIScheduler();
+
+  // Pops up to 'max' txn requests into '*batch', most urgent first (in order
+  // of 'Txn::SchedulingDeadline()'), and returns how many were popped.
+  int PopTxnRequests(vector<Txn*>* batch, uint32 max);
+
+  // Has a worker thread run 'method' on 'txn', ahead of other work if 'txn'
+  // is PRIORITY_HIGH, and otherwise on the queue chosen by 'routing_'.
+  typedef void (TxnProcessor::*TxnMethod)(Txn* txn);
+  void DispatchTxn(TxnMethod method, Txn* txn);
+
+  // Returns the worker queue owning most of 'txn's keys (see
+  // ROUTE_KEY_AFFINITY).
+  int HomeQueue(Txn* txn);
+
+  // Puts the scheduler thread to sleep until it is notified of new work (on
+  // 'scheduler_work_'), unless there is work already. Wakes up after at most
+  // 'timeout' seconds regardless. Pending txn requests only count as work if
+  // 'accepting' (schedulers may hold them back, e.g. while ADAPTIVE switches
+  // protocols).
+  void ParkScheduler(double timeout, bool accepting);
+  void ParkScheduler();
+
+  // If 'txn' has been suspended in a 'WAIT()' (see txn.h), files it to be
+  // resumed by a worker thread running 'resume' once the wait is over, and
+  // returns true. Otherwise returns false.
+  //
+  // Methods that run a txn's logic on a worker thread set 'suspendable_'
+  // first, call 'SuspendTxn()' after it returns, and skip straight to
+  // running the logic again when called with a suspended txn.
+  bool SuspendTxn(Txn* txn, TxnMethod resume);
+
+  // Main loop of the thread that resumes suspended txns when their waits are
+  // over.
+  void RunWaker();
+
   // Performs all reads required to execute the transaction, then executes the
   // transaction logic.
   void ExecuteTxn(Txn* txn);
 
+  // Executes a read-only txn against a consistent snapshot of 'storage_',
+  // without involving the scheduler, and returns its result directly. Falls
+  // back to the regular path if no snapshot can be obtained.
+  void ExecuteReadOnlyTxn(Txn* txn);
+
+  // Reads the readset of '*txn' into its 'reads_'. Returns false if writes
+  // were being installed concurrently, in which case the reads may not be
+  // consistent.
+  bool ReadSnapshot(Txn* txn);
+
+  // Mark the installation of a txn's writes (see 'installing_').
+  void BeginInstall();
+  void EndInstall();
+
+  // Claims one of the 'admission_limit_' slots for a new txn, failing (or
+  // blocking) if all are taken.
+  bool TryReserveSlot(TxnPriority priority);
+  void ReserveSlot(TxnPriority priority);
+
+  // Frees the slot of a finished txn, and periodically adapts the admission
+  // limit.
+  void ReleaseSlot();
+
+  // Adapts 'admission_limit_' at the end of each measurement window in which
+  // it was reached, by hill climbing on throughput: the limit grows
+  // additively as long as throughput improves and txns rarely restart, and
+  // otherwise shrinks multiplicatively until throughput drops while txns
+  // rarely restart.
+  //
+  // Requires: 'admission_mutex_' is held.
+  void AdaptAdmissionLimit();
+
+  // Records that a txn is being restarted (for 'AdaptAdmissionLimit()').
+  void CountRestart() {
+    __sync_fetch_and_add(&admission_restarts_, 1);
+  }
+
+  // Prepares a new txn request for scheduling. Returns false if the txn has
+  // already been started (or finished) by other means, else the caller must
+  // add it to 'txn_requests_'. Txns that need reconnaissance are ABORTED
+  // right away unless 'recon_supported_'.
+  bool AdmitTxn(Txn* txn, TxnCallback* callback);
+
+  // Hands the result of a COMMITTED or ABORTED txn to its client (see
+  // 'NewTxnRequest()').
+  void FinishTxn(Txn* txn);
+
+  // Like 'ExecuteTxn()', but also installs the writes of a txn that votes to
+  // commit (used by the locking schedulers, where the txn holds its locks).
+  template <CCMode kMode>
+  void ExecuteAndCommitTxn(Txn* txn);
+
+  // Installs the writes of a validated txn and hands it back to the
+  // scheduler through 'committed_txns_' (used by OCC).
+  void CommitTxn(Txn* txn);
+
+  // Adds the records updated by '*txn' to (or removes them from)
+  // 'committing_keys_'.
+  void BeginCommit(Txn* txn);
+  void EndCommit(Txn* txn);
+
+  // Same as 'ExecuteTxn()', but commits (or aborts) the txn and returns its
+  // result to the client on the calling thread.
+  //
+  // Requires: no other thread accesses any of the txn's records concurrently.
+  void ExecuteTxnInline(Txn* txn);
+
+  // Performs all reads required to execute the transaction, then executes the
+  // transaction logic (the part shared by 'ExecuteTxn()' and
+  // 'ExecuteTxnInline()').
+  void RunTxnLogic(Txn* txn);
+
   // Does the validation phase for all the transactions. Upon completion,
-  // deposits the transaction back to the scheduler through 'validated_txns_'
-  void ValidateTxn(Txn *txn, map<Txn*, Txn*> active_set);
+  // deposits the transaction back to the scheduler through 'validated_txns_'.
+  // Transactions in validation are tracked in 'validation_slots_' rather than
+  // in a centrally maintained active set.
+  void ValidateTxn(Txn *txn);
+
+  // Claims (and returns) a free slot in 'validation_slots_', waiting for one
+  // to become available if necessary.
+  int ClaimValidationSlot(Txn* txn);
+
+  // Version of 'ExecuteTxn' used by the decentralised OCC modes (SILO and
+  // TICTOC). Reads every record together with its version word, runs the txn
+  // logic, and then validates and commits (or restarts) the txn on the calling
+  // worker thread. 'kMode' is SILO or TICTOC.
+  template <CCMode kMode>
+  void ExecuteTxnLocally(Txn* txn);
+
+  // Reads the record with the specified key into 'txn->reads_', and the
+  // (unlocked) version word 'word' that guarded it into 'txn->read_versions_'.
+  // 'lock_bit' is the bit of '*word' that is set while a commit holds it.
+  void ReadVersioned(Txn* txn, const Key& key, volatile uint64* word,
+                     uint64 lock_bit);
+
+  // Silo commit protocol: locks the txn's write set in a global order,
+  // validates the TID words of everything it read, and installs its writes
+  // under a freshly generated TID. Returns false (having released all locks)
+  // if validation fails.
+  bool SiloCommit(Txn* txn);
 
-  // Applies all writes performed by '*txn' to 'storage_'.
+  // TicToc commit protocol: locks the txn's write set in a global order,
+  // computes the commit timestamp from the timestamps of the records it
+  // accessed, extends the read timestamps of everything it read up to the
+  // commit timestamp, and installs its writes. Returns false (having released
+  // all locks) if validation fails.
+  bool TicTocCommit(Txn* txn);
+
+  // Version of 'ExecuteTxn' used by SSI: performs all reads against the txn's
+  // snapshot ('txn->snapshot_ts_'), then executes the transaction logic.
+  void ExecuteTxnSnapshot(Txn* txn);
+
+  // Commit-time SSI check for an update txn. Returns false if committing
+  // 'txn' would violate first-committer-wins, or would make it the pivot of a
+  // dangerous structure: a concurrent txn has read something 'txn' writes
+  // (rw-antidependency into 'txn'), and 'txn' has read something that a
+  // concurrent, already committed txn wrote (rw-antidependency out of 'txn').
+  //
+  // Requires: 'txn' has already been removed from the SSI active set.
+  bool ValidateSSI(Txn* txn);
+
+  // Adds 'txn' to (or removes it from) the set of active SSI txns.
+  void RegisterSSI(Txn* txn);
+  void UnregisterSSI(Txn* txn);
+
+  // Drops the 'ssi_last_read_' entries at or below the oldest active
+  // snapshot (or the current clock if there is none). Every txn that will
+  // still be validated started no earlier, so it cannot conflict with them.
+  void PruneSSIReads();
+
+  // Requests locks from 'lm_' on everything 'txn' reads, writes or
+  // increments, and returns true if all of them were granted immediately.
+  // Increments take INCREMENT locks, which txns that only increment a record
+  // can hold together (LockManagerA grants every lock exclusively, though).
+  //
+  // Requires: 'lm_' is a 'LockManagerT'.
+  template <class LockManagerT>
+  bool RequestLocks(Txn* txn);
+
+  // Releases (or cancels the requests for) all locks requested by
+  // 'RequestLocks()'.
+  template <class LockManagerT>
+  void ReleaseLocks(Txn* txn);
+
+  // Returns true if the locks that 'RequestLocks()' requests for 'a' and 'b'
+  // conflict.
+  static bool LocksConflict(Txn* a, Txn* b);
+
+  // Reorders a batch of txns (used by LOCKING_BATCH) into groups of txns
+  // without conflicting locks, keeping txns in arrival order within groups.
+  void ReorderBatch(vector<Txn*>* batch);
+
+  // Runs the reconnaissance phase of a txn with a nonempty reconset: reads
+  // the reconset without any concurrency control, and has the txn compute
+  // its read, write and delta sets from the values read.
+  void Reconnoiter(Txn* txn);
+
+  // Returns true if running 'Txn::Recon()' against the values in
+  // 'txn->reads_' yields the sets the txn was scheduled with. The txn's sets
+  // are left unchanged either way.
+  bool ReconStillValid(Txn* txn);
+
+  // Re-runs reconnaissance for a txn whose sets turned out to be stale, and
+  // resubmits it.
+  //
+  // Requires: the txn holds no locks.
+  void RestartReconTxn(Txn* txn);
+
+  // Returns true if 'key' was written at or after 'time' (e.g. a txn's
+  // 'occ_start_time_'). Writes are installed concurrently with txns
+  // starting, so a write in the same clock tick as 'time' counts as a later
+  // one.
+  bool WrittenSince(Key key, double time) {
+    return storage_.Timestamp(key) >= time;
+  }
+
+  // Applies all writes (and increments) performed by '*txn' to 'storage_'.
   //
   // Requires: txn->Status() is COMPLETED_C.
   void ApplyWrites(Txn* txn);
 
+  // Restores the before-images of all records '*txn' updated in place (see
+  // 'Txn::undo_log_'). Called while the txn still holds its locks.
+  void UndoWrites(Txn* txn);
+
   // Concurrency control mechanism the TxnProcessor is currently using.
   CCMode mode_;
 
   // Thread pool managing all threads used by TxnProcessor.
   StaticThreadPool tp_;
 
+  // Routing of txns to the thread pool's queues.
+  TaskRouting routing_;
+
   // Data storage used for all modes.
   Storage storage_;
 
-  // Next valid unique_id, and a mutex to guard incoming txn requests.
-  int next_unique_id_;
-  Mutex mutex_;
+  // Next valid unique_id (assigned atomically).
+  volatile uint64 next_unique_id_;
+
+  // Admission control. Number of txns in flight, limit on that number, and
+  // whether the limit adapts.
+  volatile int in_flight_;
+  volatile int admission_limit_;
+  bool admission_adaptive_;
+
+  // Notified whenever a slot is freed or the limit is raised.
+  EventCount admission_ready_;
+
+  // Measurement window of 'AdaptAdmissionLimit()'. Only the counters are
+  // updated without holding 'admission_mutex_'.
+  Mutex admission_mutex_;
+  double admission_window_start_;
+  volatile int admission_finished_;    // Txns finished in the window.
+  volatile int admission_restarts_;    // Txns restarted in the window.
+  volatile bool admission_saturated_;  // Limit was reached in the window.
+  double admission_throughput_;        // Throughput of the previous window.
+  bool admission_increasing_;          // Current direction of adaptation.
 
   // Queue of incoming transaction requests.
   AtomicQueue<Txn*> txn_requests_;
 
+  // Notified whenever a txn is handed to the scheduler thread from elsewhere.
+  EventCount scheduler_work_;
+
   // Queue of txns that have acquired all locks and are ready to be executed.
   //
   // Does not need to be atomic because RunScheduler is the only thread that
   // will ever access this queue.
   deque<Txn*> ready_txns_;
 
+  // Queue of committed/aborted txns waiting for their outcome to become
+  // durable (in the locking modes), with the time at which it does.
+  //
+  // Does not need to be atomic because RunScheduler is the only thread that
+  // will ever access this queue.
+  deque<pair<double, Txn*> > log_pending_;
+
+  // Time it takes for an outcome to become durable (see
+  // 'ExecutorOptions::log_flush_latency_').
+  double log_flush_latency_;
+
   // Queue of completed (but not yet committed/aborted) transactions.
   AtomicQueue<Txn*> completed_txns_;
 
+  // Queue of validated transactions whose writes have been installed by a
+  // worker thread (see 'CommitTxn()').
+  AtomicQueue<Txn*> committed_txns_;
+
+  // Number of validated txns still installing writes to each record (used by
+  // OCC).
+  unordered_map<Key, int> committing_keys_;
+
   // Queue of validated transactions that are ready to be committed/aborted
   AtomicQueue<pair<Txn*, bool>> validated_txns_;
 
@@ -115,12 +600,221 @@ class TxnProcessor {
   // to client.
   AtomicQueue<Txn*> txn_results_;
 
-  // Active Set of the thread pool. Do not need this to be atomic because
-  // multiple threads never read and write this at the same time.
-  map<Txn*, Txn*> active_set_;
+  // Notified whenever a result is added to 'txn_results_'.
+  EventCount results_ready_;
+
+  // Notified whenever a 'TxnSession' has no txns outstanding any more. It
+  // lives here rather than in the session, since the session may be
+  // destroyed as soon as its last txn is done.
+  EventCount sessions_idle_;
 
-  // Lock Manager used for LOCKING concurrency implementations.
+  // Suspended txns, keyed by the time at which they are to be resumed, with
+  // the method to resume them with, and a mutex to guard them.
+  multimap<double, pair<Txn*, TxnMethod> > suspended_txns_;
+  Mutex suspended_mutex_;
+
+  // Notified whenever a txn is suspended with an earlier wake-up time than
+  // all others.
+  EventCount waker_work_;
+
+  // Lock-free active set used for parallel validation (P_OCC). Each txn in
+  // validation occupies one slot, holding the signatures of its write set.
+  // Validators publish their slot before being assigned a sequence number,
+  // and check themselves only against slots with smaller sequence numbers, so
+  // every pair of concurrently validating txns is checked exactly once.
+  struct ValidationSlot {
+    volatile int taken_;    // Nonzero while the slot is owned by a validator.
+    volatile uint64 seq_;   // Owner's validation sequence number (0 if not
+                            //  yet assigned).
+    Signature writes_;      // Signature of the owner's writeset and
+                            //  deltaset.
+    Signature overwrites_;  // Signature of the owner's writeset alone.
+  };
+  static const int kValidationSlots = 128;
+  ValidationSlot validation_slots_[kValidationSlots];
+
+  // Last validation sequence number handed out.
+  volatile uint64 validation_seq_;
+
+  // Txns waiting out a backoff before being retried (H_OCC), keyed by the
+  // time at which they may be restarted. Only accessed by the scheduler.
+  multimap<double, Txn*> backoff_txns_;
+
+  // Retry statistics, and a mutex to guard them.
+  RetryStats retry_stats_;
+  Mutex stats_mutex_;
+
+  // Adds the latency of a finished txn to the latency statistics.
+  void RecordLatency(Txn* txn);
+
+  // Latency histograms per priority class, updated atomically. Bucket 'i'
+  // counts latencies below 2^((i + 1) / kLatencyBucketsPerDoubling)
+  // microseconds.
+  static const int kLatencyBucketsPerDoubling = 8;
+  static const int kLatencyBuckets = 40 * kLatencyBucketsPerDoubling;
+  volatile uint64 latency_buckets_[PRIORITY_HIGH + 1][kLatencyBuckets];
+  volatile uint64 latency_sum_[PRIORITY_HIGH + 1];  // In microseconds.
+  volatile uint64 latency_max_[PRIORITY_HIGH + 1];  // In microseconds.
+
+  // ADAPTIVE bookkeeping. Only ever accessed by the scheduler thread.
+  //
+  // Protocol currently in use, and the protocol to switch to once all txns
+  // admitted under it have finished (equal to 'adaptive_mode_' if no switch
+  // is pending).
+  CCMode adaptive_mode_;
+  CCMode adaptive_next_;
+
+  // Number of admitted txns that have not yet committed or aborted.
+  int adaptive_in_flight_;
+
+  // Statistics gathered over the current observation window.
+  struct AdaptiveWindow {
+    double start_;       // Time at which the window was opened.
+    int finished_;       // Txns committed or aborted.
+    int restarts_;       // Txns restarted after failing OCC validation.
+    int executions_;     // Txn executions (including restarted ones).
+    double exec_time_;   // Total time spent executing txns.
+    double lock_wait_;   // Total time spent waiting for locks.
+  };
+  AdaptiveWindow adaptive_window_;
+
+  // Smoothed throughput last observed under each protocol (0 if never
+  // observed), and the number of windows since it was observed.
+  double adaptive_throughput_[ADAPTIVE];
+  int adaptive_age_[ADAPTIVE];
+
+  // PARTITIONED bookkeeping.
+  //
+  // A multi-partition txn, shared by the queues of every partition it spans.
+  struct MultiPartitionTxn {
+    Txn* txn_;
+    volatile int pending_;  // Partitions that have not yet reached the txn.
+    volatile int done_;     // Nonzero once the txn has been executed.
+    volatile int refs_;     // Partitions that have not yet finished with it.
+    EventCount executed_;   // Notified once 'done_' is set.
+  };
+
+  // Entry in a partition's queue: a txn, together with its multi-partition
+  // bookkeeping if it spans more than one partition (else NULL).
+  struct PartitionTask {
+    Txn* txn_;
+    MultiPartitionTxn* multi_;
+  };
+
+  // Adds 'task' to partition 'p's queue, waking the partition if it is
+  // parked.
+  void QueuePartitionTask(int p, const PartitionTask& task);
+
+  // Queue of txns to be run by each partition.
+  static const int kPartitions = 8;
+  AtomicQueue<PartitionTask> partition_queues_[kPartitions];
+
+  // Notified whenever a task is added to the corresponding partition queue.
+  EventCount partition_work_[kPartitions];
+
+  // LAZY bookkeeping. Only ever accessed by the scheduler thread.
+  //
+  // A deferred txn (a clone of the one reported committed), together with
+  // the earlier deferred txns whose stickies it found on its records.
+  struct LazyTxn {
+    Txn* txn_;
+    vector<uint64> deps_;
+  };
+
+  // Deferred txns that have not yet been run, by position in the serial
+  // order.
+  map<uint64, LazyTxn> lazy_txns_;
+
+  // Latest deferred txn to access each record that has a sticky.
+  unordered_map<Key, uint64> lazy_stickies_;
+
+  // Position of the last txn in the serial order.
+  uint64 lazy_seq_;
+
+  // Lock Manager used for LOCKING (and H_OCC) concurrency implementations.
   LockManager* lm_;
+
+  // Global epoch number used to generate SILO commit TIDs. Advanced
+  // periodically by the scheduler thread.
+  volatile uint64 epoch_;
+
+  // SSI bookkeeping. Only ever accessed by the scheduler thread.
+  //
+  // Logical clock, advanced at every SSI commit and read-only completion.
+  // Snapshots and version timestamps are both drawn from this clock.
+  uint64 ssi_clock_;
+
+  // Snapshot timestamps of all active SSI txns.
+  multiset<uint64> ssi_snapshots_;
+
+  // Number of active SSI txns with each key in their readset.
+  unordered_map<Key, int> ssi_active_readers_;
+
+  // Clock value at which the last txn with each key in its readset finished.
+  unordered_map<Key, uint64> ssi_last_read_;
+
+  // The (clock value, key) pairs added to 'ssi_last_read_', oldest first,
+  // so that entries no active txn can conflict with can be pruned.
+  deque<pair<uint64, Key> > ssi_read_log_;
+
+  // True if read-only txns bypass the scheduler (see 'ExecuteReadOnlyTxn()').
+  bool snapshot_reads_;
+
+  // True if txns with a nonempty reconset are supported (see 'Txn::Recon()').
+  // Only SERIAL and the locking schedulers restart txns whose sets turned out
+  // to be stale.
+  bool recon_supported_;
+
+  // Seqlock guarding snapshot reads: the number of txns whose writes are
+  // (about to be) installed in 'storage_', and the number of txns that have
+  // finished installing writes.
+  volatile int installing_;
+  volatile uint64 install_seq_;
+};
+
+// A client's connection to a TxnProcessor. Txns submitted through a session
+// deliver their results to the session's own completion queue rather than to
+// 'GetTxnResult()', so clients never receive (or contend for) each other's
+// results. Each session is meant to be used by a single client thread.
+//
+// Only completions are per session: submitted batches go into the
+// processor's shared request queue (in a single push, see
+// 'TxnProcessor::NewTxnRequests()'), since every scheduler pops from that
+// one queue.
+class TxnSession : public TxnCallback {
+ public:
+  explicit TxnSession(TxnProcessor* processor)
+      : processor_(processor), outstanding_(0) {}
+
+  // Waits for all of the session's txns to finish, and deletes any results
+  // that were not drained.
+  ~TxnSession();
+
+  // Registers all of 'txns' with the processor at once. Ownership of the
+  // txns is transferred to the processor.
+  void SubmitBatch(const vector<Txn*>& txns);
+
+  // Appends all finished txns of the session to '*results' without blocking,
+  // and returns their number. The caller takes ownership of the txns.
+  int DrainResults(vector<Txn*>* results);
+
+  // Blocks until at least one of the session's txns has finished.
+  void WaitForResults();
+
+  virtual void Done(Txn* txn);
+
+ private:
+  TxnProcessor* processor_;
+
+  // Finished txns not yet drained by the client.
+  AtomicQueue<Txn*> results_;
+
+  // Notified whenever a txn is added to 'results_'.
+  EventCount ready_;
+
+  // Number of submitted txns whose 'Done()' has not finished with the
+  // session yet. The destructor waits for it to drop to zero.
+  volatile int outstanding_;
 };
 
 #endif  // _TXN_PROCESSOR_H_
@@ -2,6 +2,7 @@
 
 #include "txn/txn_processor.h"
 
+#include <set>
 #include <vector>
 
 #include "txn/txn_types.h"
@@ -15,6 +16,17 @@ string ModeToString(CCMode mode) {
     case LOCKING:                return " Locking B";
     case OCC:                    return " OCC      ";
     case P_OCC:                  return " OCC-P    ";
+    case SILO:                   return " Silo     ";
+    case TICTOC:                 return " TicToc   ";
+    case SSI:                    return " SSI      ";
+    case H_OCC:                  return " OCC-H    ";
+    case ADAPTIVE:               return " Adaptive ";
+    case HEALING:                return " OCC-Heal ";
+    case PARTITIONED:            return " Partition";
+    case LAZY:                   return " Lazy     ";
+    case LOCKING_ELR:            return " Locking E";
+    case LOCKING_BATCH:          return " Locking R";
+    case LOCKING_IN_PLACE:       return " Locking U";
     default:                     return "INVALID MODE";
   }
 }
@@ -71,7 +83,594 @@ class RMWLoadGen2 : public LoadGen {
   double wait_time_;
 };
 
-void Benchmark(const vector<LoadGen*>& lg) {
+class PartitionLoadGen : public LoadGen {
+ public:
+  PartitionLoadGen(int dbsize, int rsetsize, int wsetsize, double wait_time)
+    : dbsize_(dbsize),
+      rsetsize_(rsetsize),
+      wsetsize_(wsetsize),
+      wait_time_(wait_time) {
+  }
+
+  virtual Txn* NewTxn() {
+    // All keys come from a single partition (PARTITIONED places key k in
+    // partition k % kPartitions), picked at random for each transaction.
+    int partition = rand() % kPartitions;
+    set<Key> readset, writeset;
+    while (static_cast<int>(readset.size()) < rsetsize_)
+      readset.insert(RandomKey(partition));
+    while (static_cast<int>(writeset.size()) < wsetsize_) {
+      Key key = RandomKey(partition);
+      if (!readset.count(key))
+        writeset.insert(key);
+    }
+    return new RMW(readset, writeset, wait_time_);
+  }
+
+ private:
+  static const int kPartitions = 8;
+
+  Key RandomKey(int partition) {
+    return partition + kPartitions * (rand() % (dbsize_ / kPartitions));
+  }
+
+  int dbsize_;
+  int rsetsize_;
+  int wsetsize_;
+  double wait_time_;
+};
+
+class BumpLoadGen : public LoadGen {
+ public:
+  BumpLoadGen(int dbsize, int deltasetsize, double wait_time)
+    : dbsize_(dbsize),
+      deltasetsize_(deltasetsize),
+      wait_time_(wait_time) {
+  }
+
+  virtual Txn* NewTxn() {
+    return new Bump(dbsize_, deltasetsize_, wait_time_);
+  }
+
+ private:
+  int dbsize_;
+  int deltasetsize_;
+  double wait_time_;
+};
+
+class ShiftingLoadGen : public LoadGen {
+ public:
+  ShiftingLoadGen(int dbsize1, int dbsize2, int setsize, double wait_time,
+                  int period)
+    : dbsize1_(dbsize1),
+      dbsize2_(dbsize2),
+      setsize_(setsize),
+      wait_time_(wait_time),
+      period_(period),
+      count_(0) {
+  }
+
+  virtual Txn* NewTxn() {
+    // Alternates between two databases sizes (and therefore two levels of
+    // contention) every 'period_' transactions.
+    int dbsize = ((count_++ / period_) % 2 == 0) ? dbsize1_ : dbsize2_;
+    return new RMW(dbsize, setsize_, setsize_, wait_time_);
+  }
+
+ private:
+  int dbsize1_;
+  int dbsize2_;
+  int setsize_;
+  double wait_time_;
+  int period_;
+  int count_;
+};
+
+// Inserts many batches of new records concurrently in every mode, then
+// checks that every batch is there.
+TEST(ConcurrentInserts) {
+  const int kBatches = 400;
+  const int kBatchSize = 50;
+  for (CCMode mode = SERIAL;
+      mode <= LOCKING_IN_PLACE;
+      mode = static_cast<CCMode>(mode+1)) {
+    TxnProcessor p(mode);
+    vector<map<Key, Value> > batches(kBatches);
+    for (int b = 0; b < kBatches; b++) {
+      for (int i = 0; i < kBatchSize; i++)
+        batches[b][b * kBatchSize + i] = b;
+      p.NewTxnRequest(new Put(batches[b]));
+    }
+    for (int b = 0; b < kBatches; b++)
+      delete p.GetTxnResult();
+
+    int found = 0;
+    for (int b = 0; b < kBatches; b++)
+      p.NewTxnRequest(new Expect(batches[b]));
+    for (int b = 0; b < kBatches; b++) {
+      Txn* txn = p.GetTxnResult();
+      if (txn->Status() == COMMITTED)
+        found++;
+      delete txn;
+    }
+    if (found != kBatches)
+      cout << ModeToString(mode) << ": " << found << " of " << kBatches
+           << " batches found" << endl;
+    EXPECT_EQ(kBatches, found);
+  }
+
+  END;
+}
+
+// Reads the records [0, size) and commits, keeping their sum.
+class Sum : public Txn {
+ public:
+  Sum(Key first, int size) : first_(first), size_(size), sum_(0) {
+    for (int i = 0; i < size_; i++)
+      readset_.insert(first_ + i);
+  }
+
+  Sum* clone() const {             // Virtual constructor (copying)
+    Sum* clone = new Sum(first_, size_);
+    this->CopyTxnInternals(clone);
+    return clone;
+  }
+
+  virtual void Run() {
+    sum_ = 0;
+    for (int i = 0; i < size_; i++) {
+      Value value = 0;
+      Read(first_ + i, &value);
+      sum_ += value;
+    }
+    COMMIT;
+  }
+
+  Key first_;
+  int size_;
+  Value sum_;
+};
+
+// Runs a mix of conflicting read-modify-write and increment txns in every
+// mode, then checks that each committed txn's updates are reflected in the
+// database exactly once.
+TEST(ConcurrentUpdatesSum) {
+  const int kRecords = 20;
+  const int kTxns = 2000;
+  const int kActive = 50;
+  for (CCMode mode = SERIAL;
+      mode <= LOCKING_IN_PLACE;
+      mode = static_cast<CCMode>(mode+1)) {
+    TxnProcessor p(mode);
+    map<Key, Value> init;
+    for (int i = 0; i < kRecords; i++)
+      init[i] = 0;
+    p.NewTxnRequest(new Put(init));
+    delete p.GetTxnResult();
+
+    // Each RMW increments 3 records, each Bump 2.
+    Value expected = 0;
+    for (int i = 0; i < kTxns + kActive; i++) {
+      if (i < kTxns) {
+        if (rand() % 2)
+          p.NewTxnRequest(new Bump(kRecords, 2));
+        else
+          p.NewTxnRequest(new RMW(kRecords, 2, 3));
+      }
+      if (i >= kActive) {
+        Txn* txn = p.GetTxnResult();
+        if (txn->Status() == COMMITTED)
+          expected += (dynamic_cast<Bump*>(txn) != NULL) ? 2 : 3;
+        delete txn;
+      }
+    }
+
+    Sum* sum = new Sum(0, kRecords);
+    p.NewTxnRequest(sum);
+    p.GetTxnResult();
+    if (sum->sum_ != expected)
+      cout << ModeToString(mode) << ": sum " << sum->sum_ << ", expected "
+           << expected << endl;
+    EXPECT_EQ(expected, sum->sum_);
+    delete sum;
+  }
+
+  END;
+}
+
+// Runs read-only txns alongside writers that increment every record, in
+// every mode, and checks that each read-only txn saw all records at the same
+// value.
+TEST(ConsistentReads) {
+  const int kRecords = 10;
+  const int kTxns = 2000;
+  const int kActive = 50;
+  for (CCMode mode = SERIAL;
+      mode <= LOCKING_IN_PLACE;
+      mode = static_cast<CCMode>(mode+1)) {
+    TxnProcessor p(mode);
+    map<Key, Value> init;
+    for (int i = 0; i < kRecords; i++)
+      init[i] = 0;
+    p.NewTxnRequest(new Put(init));
+    delete p.GetTxnResult();
+
+    int inconsistent = 0;
+    for (int i = 0; i < kTxns + kActive; i++) {
+      if (i < kTxns) {
+        if (rand() % 2)
+          p.NewTxnRequest(new Sum(0, kRecords));
+        else
+          p.NewTxnRequest(new RMW(kRecords, 0, kRecords));
+      }
+      if (i >= kActive) {
+        Txn* txn = p.GetTxnResult();
+        Sum* sum = dynamic_cast<Sum*>(txn);
+        if (sum != NULL && sum->Status() == COMMITTED &&
+            sum->sum_ % kRecords != 0)
+          inconsistent++;
+        delete txn;
+      }
+    }
+    if (inconsistent != 0)
+      cout << ModeToString(mode) << ": " << inconsistent
+           << " inconsistent reads" << endl;
+    EXPECT_EQ(0, inconsistent);
+  }
+
+  END;
+}
+
+// Runs txns whose writesets depend on the data while other txns change that
+// data. Modes that support reconnaissance must restart and commit every such
+// txn, applying it exactly once; the others must abort them without running.
+TEST(ReconRestart) {
+  const int kPointers = 10;
+  const int kTargets = 100;
+  const int kTxns = 1000;
+  const int kActive = 50;
+  for (CCMode mode = SERIAL;
+      mode <= LOCKING_IN_PLACE;
+      mode = static_cast<CCMode>(mode+1)) {
+    TxnProcessor p(mode);
+    map<Key, Value> init;
+    for (int i = 0; i < kPointers; i++)
+      init[i] = kPointers + i;
+    for (int i = 0; i < kTargets; i++)
+      init[kPointers + i] = 0;
+    p.NewTxnRequest(new Put(init));
+    delete p.GetTxnResult();
+
+    // Every other txn redirects a random pointer to a random target.
+    Value committed = 0, aborted = 0;
+    for (int i = 0; i < kTxns + kActive; i++) {
+      if (i < kTxns) {
+        if (i % 2) {
+          p.NewTxnRequest(new Indirect(rand() % kPointers));
+        } else {
+          map<Key, Value> m;
+          m[rand() % kPointers] = kPointers + rand() % kTargets;
+          p.NewTxnRequest(new Put(m));
+        }
+      }
+      if (i >= kActive) {
+        Txn* txn = p.GetTxnResult();
+        if (dynamic_cast<Indirect*>(txn) != NULL) {
+          if (txn->Status() == COMMITTED)
+            committed++;
+          else if (txn->Status() == ABORTED)
+            aborted++;
+        }
+        delete txn;
+      }
+    }
+
+    Sum* sum = new Sum(kPointers, kTargets);
+    p.NewTxnRequest(sum);
+    p.GetTxnResult();
+    if (sum->sum_ != committed || committed + aborted != kTxns / 2)
+      cout << ModeToString(mode) << ": sum " << sum->sum_ << ", committed "
+           << committed << ", aborted " << aborted << endl;
+    EXPECT_EQ(committed, sum->sum_);
+    EXPECT_EQ(kTxns / 2, committed + aborted);
+    delete sum;
+  }
+
+  END;
+}
+
+// Counts its calls, deleting each txn it receives.
+class CountingCallback : public TxnCallback {
+ public:
+  CountingCallback() : calls_(0) {}
+
+  virtual void Done(Txn* txn) {
+    __sync_fetch_and_add(&calls_, 1);
+    delete txn;
+  }
+
+  volatile int calls_;
+};
+
+// Runs conflicting txns (which some modes restart) in every mode, each with
+// a callback of its own, and checks that every callback fires exactly once.
+TEST(CallbackOnce) {
+  const int kRecords = 10;
+  const int kTxns = 500;
+  for (CCMode mode = SERIAL;
+      mode <= LOCKING_IN_PLACE;
+      mode = static_cast<CCMode>(mode+1)) {
+    TxnProcessor p(mode);
+    map<Key, Value> init;
+    for (int i = 0; i < kRecords; i++)
+      init[i] = 0;
+    p.NewTxnRequest(new Put(init));
+    delete p.GetTxnResult();
+
+    vector<CountingCallback> callbacks(kTxns);
+    for (int i = 0; i < kTxns; i++) {
+      if (i % 2)
+        p.NewTxnRequest(new Bump(kRecords, 2), &callbacks[i]);
+      else
+        p.NewTxnRequest(new RMW(kRecords, 2, 3), &callbacks[i]);
+    }
+
+    // Wait for all callbacks, then a little longer for any repeated ones.
+    double start = GetTime();
+    int calls = 0;
+    while (calls < kTxns && GetTime() < start + 10) {
+      Sleep(0.001);
+      calls = 0;
+      for (int i = 0; i < kTxns; i++)
+        calls += callbacks[i].calls_;
+    }
+    Sleep(0.01);
+
+    int wrong = 0;
+    for (int i = 0; i < kTxns; i++) {
+      if (callbacks[i].calls_ != 1)
+        wrong++;
+    }
+    if (wrong != 0)
+      cout << ModeToString(mode) << ": " << wrong << " of " << kTxns
+           << " callbacks not called exactly once" << endl;
+    EXPECT_EQ(0, wrong);
+  }
+
+  END;
+}
+
+// Checks in every mode that a future returns its txn with the final
+// status, and is ready from then on.
+TEST(FutureStatus) {
+  for (CCMode mode = SERIAL;
+      mode <= LOCKING_IN_PLACE;
+      mode = static_cast<CCMode>(mode+1)) {
+    TxnProcessor p(mode);
+    map<Key, Value> m;
+    m[1] = 1;
+    m[2] = 2;
+
+    TxnFuture put;
+    p.NewTxnRequest(new Put(m), &put);
+    Txn* txn = put.Get();
+    EXPECT_EQ(COMMITTED, txn->Status());
+    EXPECT_TRUE(put.Ready());
+    delete txn;
+
+    TxnFuture expect;
+    p.NewTxnRequest(new Expect(m), &expect);
+    txn = expect.Get();
+    EXPECT_EQ(COMMITTED, txn->Status());
+    delete txn;
+
+    m[2] = 3;
+    TxnFuture mismatch;
+    p.NewTxnRequest(new Expect(m), &mismatch);
+    txn = mismatch.Get();
+    EXPECT_EQ(ABORTED, txn->Status());
+    EXPECT_TRUE(mismatch.Ready());
+    delete txn;
+  }
+
+  END;
+}
+
+// Records the order in which its txns finish. The txns are left to the
+// caller.
+class OrderCallback : public TxnCallback {
+ public:
+  virtual void Done(Txn* txn) {
+    mutex_.Lock();
+    order_.push_back(txn);
+    mutex_.Unlock();
+  }
+
+  Mutex mutex_;
+  vector<Txn*> order_;
+};
+
+// Queues txns of different priority classes behind a long txn in SERIAL
+// mode, which runs each batch of queued txns by 'SchedulingDeadline()'. A
+// low-priority txn must run after newer normal txns until it has waited out
+// its extra slack, and ahead of them after that.
+TEST(PriorityAging) {
+  TxnProcessor p(SERIAL);
+  OrderCallback callback;
+
+  // Keeps the scheduler busy for about 0.1s.
+  Txn* blocker = new RMW(0.1);
+  p.NewTxnRequest(blocker, &callback);
+  Sleep(0.01);
+
+  // Normal txns get 0.01s of slack, low-priority ones 0.02s.
+  Txn* old_low = new Noop();
+  old_low->SetPriority(PRIORITY_LOW);
+  p.NewTxnRequest(old_low, &callback);
+  Sleep(0.015);
+  Txn* normal1 = new Noop();
+  p.NewTxnRequest(normal1, &callback);
+  Txn* new_low = new Noop();
+  new_low->SetPriority(PRIORITY_LOW);
+  p.NewTxnRequest(new_low, &callback);
+  Txn* normal2 = new Noop();
+  p.NewTxnRequest(normal2, &callback);
+
+  while (true) {
+    callback.mutex_.Lock();
+    int finished = callback.order_.size();
+    callback.mutex_.Unlock();
+    if (finished == 5)
+      break;
+    Sleep(0.001);
+  }
+
+  EXPECT_TRUE(callback.order_[0] == blocker);
+  EXPECT_TRUE(callback.order_[1] == old_low);
+  EXPECT_TRUE(callback.order_[2] == normal1);
+  EXPECT_TRUE(callback.order_[3] == normal2);
+  EXPECT_TRUE(callback.order_[4] == new_low);
+  for (int i = 0; i < 5; i++)
+    delete callback.order_[i];
+
+  END;
+}
+
+// Waits for 'duration' seconds, counting the instances alive.
+class Tracked : public Txn {
+ public:
+  explicit Tracked(double duration) : duration_(duration) {
+    __sync_fetch_and_add(&live_, 1);
+  }
+
+  virtual ~Tracked() {
+    __sync_fetch_and_sub(&live_, 1);
+  }
+
+  Tracked* clone() const {             // Virtual constructor (copying)
+    Tracked* clone = new Tracked(duration_);
+    this->CopyTxnInternals(clone);
+    return clone;
+  }
+
+  virtual void Run() {
+    TXN_BEGIN;
+    WAIT(duration_);
+    COMMIT;
+    TXN_END;
+  }
+
+  static volatile int live_;
+
+ private:
+  double duration_;
+};
+
+volatile int Tracked::live_ = 0;
+
+// Destroys sessions with txns still running in every mode. Each destructor
+// must wait for the txns and delete their results, so that none is left
+// once it returns.
+TEST(SessionDrain) {
+  for (CCMode mode = SERIAL;
+      mode <= LOCKING_IN_PLACE;
+      mode = static_cast<CCMode>(mode+1)) {
+    TxnProcessor p(mode);
+    {
+      TxnSession session(&p);
+      vector<Txn*> batch;
+      for (int i = 0; i < 20; i++)
+        batch.push_back(new Tracked(0.005));
+      session.SubmitBatch(batch);
+    }
+    if (Tracked::live_ != 0)
+      cout << ModeToString(mode) << ": " << Tracked::live_
+           << " txns left after the session" << endl;
+    EXPECT_EQ(0, Tracked::live_);
+  }
+
+  END;
+}
+
+// Checks the latency statistics of each priority class against txns of
+// known length.
+TEST(LatencyStats) {
+  const int kTxns = 100;
+  const double kDuration = 0.002;
+  TxnProcessor p(LOCKING);
+  for (int i = 0; i < kTxns; i++) {
+    Txn* txn = new Tracked(kDuration);
+    txn->SetPriority(i % 2 ? PRIORITY_HIGH : PRIORITY_LOW);
+    p.NewTxnRequest(txn);
+  }
+  for (int i = 0; i < kTxns; i++)
+    delete p.GetTxnResult();
+
+  TxnProcessor::LatencyStats normal = p.GetLatencyStats(PRIORITY_NORMAL);
+  EXPECT_EQ(0, normal.count_);
+  EXPECT_EQ(0, normal.max_);
+  TxnPriority priorities[] = { PRIORITY_LOW, PRIORITY_HIGH };
+  for (int i = 0; i < 2; i++) {
+    TxnProcessor::LatencyStats stats = p.GetLatencyStats(priorities[i]);
+    EXPECT_EQ(kTxns / 2, stats.count_);
+    EXPECT_TRUE(stats.p50_ >= kDuration * 0.9);
+    EXPECT_TRUE(stats.p50_ <= stats.p99_);
+    EXPECT_TRUE(stats.p99_ <= stats.max_);
+    EXPECT_TRUE(stats.mean_ >= kDuration * 0.9);
+    EXPECT_TRUE(stats.mean_ <= stats.max_);
+  }
+
+  END;
+}
+
+// Checks that a fixed admission limit holds back txns beyond it, and that
+// the adaptive limit shrinks when more txns are kept in flight than a
+// high-contention workload can use.
+TEST(AdmissionLimit) {
+  ExecutorOptions fixed;
+  fixed.admission_limit_ = 8;
+  TxnProcessor p(LOCKING, fixed);
+  int admitted = 0;
+  for (int i = 0; i < 20; i++) {
+    Txn* txn = new RMW(1000, 2, 2, 0.01);
+    if (p.TryNewTxnRequest(txn, NULL))
+      admitted++;
+    else
+      delete txn;
+  }
+  EXPECT_EQ(8, admitted);
+  for (int i = 0; i < admitted; i++)
+    delete p.GetTxnResult();
+
+  // 100% contention OCC, with 200 txns in flight for a second.
+  const int kRecords = 10;
+  const int kActive = 200;
+  TxnProcessor q(OCC);
+  int initial_limit = q.AdmissionLimit();
+  map<Key, Value> init;
+  for (int i = 0; i < kRecords; i++)
+    init[i] = 0;
+  q.NewTxnRequest(new Put(init));
+  delete q.GetTxnResult();
+  double start = GetTime();
+  for (int i = 0; i < kActive; i++)
+    q.NewTxnRequest(new RMW(kRecords, 0, 5, 0.0001));
+  while (GetTime() < start + 1) {
+    delete q.GetTxnResult();
+    q.NewTxnRequest(new RMW(kRecords, 0, 5, 0.0001));
+  }
+  int limit = q.AdmissionLimit();
+  for (int i = 0; i < kActive; i++)
+    delete q.GetTxnResult();
+  if (limit >= initial_limit)
+    cout << "Adaptive limit " << limit << ", initially " << initial_limit
+         << endl;
+  EXPECT_TRUE(limit < initial_limit);
+
+  END;
+}
+
+void Benchmark(const vector<LoadGen*>& lg, const ExecutorOptions& options) {
   // Number of transaction requests that can be active at any given time.
   int active_txns = 100;
   deque<Txn*> doneTxns;
@@ -83,7 +682,7 @@ void Benchmark(const vector<LoadGen*>& lg) {
 
   // For each MODE...
   for (CCMode mode = SERIAL;
-      mode <= P_OCC;
+      mode <= LOCKING_IN_PLACE;
       mode = static_cast<CCMode>(mode+1)) {
     // Print out mode name.
     cout << ModeToString(mode) << flush;
@@ -93,7 +692,7 @@ void Benchmark(const vector<LoadGen*>& lg) {
       int txn_count = 0;
 
       // Create TxnProcessor in next mode.
-      TxnProcessor* p = new TxnProcessor(mode);
+      TxnProcessor* p = new TxnProcessor(mode, options);
 
       // Initialize data with initial db state.
       Put init_txn(db_init);
@@ -127,6 +726,8 @@ void Benchmark(const vector<LoadGen*>& lg) {
       cout << "\t" << (txn_count / (end-start)) << "\t" << flush;
 
       // Delete TxnProcessor and completed transactions.
+      for (uint32 i = 0; i < doneTxns.size(); i++)
+        delete doneTxns[i];
       doneTxns.clear();
       delete p;
     }
@@ -136,19 +737,38 @@ void Benchmark(const vector<LoadGen*>& lg) {
 }
 
 int main(int argc, char** argv) {
+  ConcurrentInserts();
+  ConcurrentUpdatesSum();
+  ConsistentReads();
+  ReconRestart();
+  CallbackOnce();
+  FutureStatus();
+  PriorityAging();
+  SessionDrain();
+  LatencyStats();
+  AdmissionLimit();
+
+  // Commit records take 0.1ms to become durable, so that the locking modes
+  // pay for holding locks until then (and LOCKING_ELR for not doing so).
+  ExecutorOptions options;
+  options.log_flush_latency_ = 0.0001;
+
   cout << "\t\t\t    Average Transaction Duration" << endl;
   cout << "\t\t0.1ms\t\t1ms\t\t10ms\t\t100ms";
   cout << endl;
 
   vector<LoadGen*> lg;
 
+  // Read-only txns have nothing to make durable, so they run without the
+  // simulated log. This also lets the locking modes serve them from
+  // snapshots.
   cout << "Read only" << endl;
   lg.push_back(new RMWLoadGen(10000, 10, 0, 0.0001));
   lg.push_back(new RMWLoadGen(10000, 10, 0, 0.001));
   lg.push_back(new RMWLoadGen(10000, 10, 0, 0.01));
   lg.push_back(new RMWLoadGen(10000, 10, 0, 0.1));
 
-  Benchmark(lg);
+  Benchmark(lg, ExecutorOptions());
 
   for (uint32 i = 0; i < lg.size(); i++)
     delete lg[i];
@@ -160,7 +780,19 @@ int main(int argc, char** argv) {
   lg.push_back(new RMWLoadGen(10000, 10, 10, 0.01));
   lg.push_back(new RMWLoadGen(10000, 10, 10, 0.1));
 
-  Benchmark(lg);
+  Benchmark(lg, options);
+
+  for (uint32 i = 0; i < lg.size(); i++)
+    delete lg[i];
+  lg.clear();
+
+  cout << "1% contention, partition-local" << endl;
+  lg.push_back(new PartitionLoadGen(10000, 10, 10, 0.0001));
+  lg.push_back(new PartitionLoadGen(10000, 10, 10, 0.001));
+  lg.push_back(new PartitionLoadGen(10000, 10, 10, 0.01));
+  lg.push_back(new PartitionLoadGen(10000, 10, 10, 0.1));
+
+  Benchmark(lg, options);
 
   for (uint32 i = 0; i < lg.size(); i++)
     delete lg[i];
@@ -172,7 +804,7 @@ int main(int argc, char** argv) {
   lg.push_back(new RMWLoadGen(1000, 10, 10, 0.01));
   lg.push_back(new RMWLoadGen(1000, 10, 10, 0.1));
 
-  Benchmark(lg);
+  Benchmark(lg, options);
 
   for (uint32 i = 0; i < lg.size(); i++)
     delete lg[i];
@@ -184,7 +816,13 @@ int main(int argc, char** argv) {
   lg.push_back(new RMWLoadGen(100, 10, 10, 0.01));
   lg.push_back(new RMWLoadGen(100, 10, 10, 0.1));
 
-  Benchmark(lg);
+  Benchmark(lg, options);
+
+  // Same workload, with every txn admitted right away.
+  cout << "65% contention, no admission control" << endl;
+  ExecutorOptions unlimited(options);
+  unlimited.admission_limit_ = ExecutorOptions::kUnlimitedAdmission;
+  Benchmark(lg, unlimited);
 
   for (uint32 i = 0; i < lg.size(); i++)
     delete lg[i];
@@ -197,7 +835,7 @@ int main(int argc, char** argv) {
   lg.push_back(new RMWLoadGen(10, 0, 10, 0.1));
 
 
-  Benchmark(lg);
+  Benchmark(lg, options);
 
   for (uint32 i = 0; i < lg.size(); i++)
     delete lg[i];
@@ -209,10 +847,33 @@ int main(int argc, char** argv) {
   lg.push_back(new RMWLoadGen2(100, 20, 10, 0.01));
   lg.push_back(new RMWLoadGen2(100, 20, 10, 0.1));
 
-  Benchmark(lg);
+  Benchmark(lg, options);
 
   for (uint32 i = 0; i < lg.size(); i++)
     delete lg[i];
   lg.clear();
-}
 
+  cout << "100% contention counter increments" << endl;
+  lg.push_back(new BumpLoadGen(10, 10, 0.0001));
+  lg.push_back(new BumpLoadGen(10, 10, 0.001));
+  lg.push_back(new BumpLoadGen(10, 10, 0.01));
+  lg.push_back(new BumpLoadGen(10, 10, 0.1));
+
+  Benchmark(lg, options);
+
+  for (uint32 i = 0; i < lg.size(); i++)
+    delete lg[i];
+  lg.clear();
+
+  cout << "Shifting contention (1% <-> 65%)" << endl;
+  lg.push_back(new ShiftingLoadGen(10000, 100, 10, 0.0001, 500));
+  lg.push_back(new ShiftingLoadGen(10000, 100, 10, 0.001, 500));
+  lg.push_back(new ShiftingLoadGen(10000, 100, 10, 0.01, 500));
+  lg.push_back(new ShiftingLoadGen(10000, 100, 10, 0.1, 500));
+
+  Benchmark(lg, options);
+
+  for (uint32 i = 0; i < lg.size(); i++)
+    delete lg[i];
+  lg.clear();
+}
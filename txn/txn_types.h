@@ -14,6 +14,7 @@ class Noop : public Txn {
  public:
   Noop() {}
   virtual void Run() { COMMIT; }
+  virtual bool NeverAborts() const { return true; }
 
   Noop* clone() const {             // Virtual constructor (copying)
     Noop* clone = new Noop();
@@ -47,6 +48,17 @@ class Expect : public Txn {
     COMMIT;
   }
 
+  virtual void Heal(const KeySet& stale) {
+    // Only the expectations on stale keys need to be checked again.
+    Value result;
+    for (KeySet::iterator it = stale.begin(); it != stale.end(); ++it) {
+      if (!Read(*it, &result) || result != m_[*it]) {
+        ABORT;
+      }
+    }
+    COMMIT;
+  }
+
  private:
   map<Key, Value> m_;
 };
@@ -71,6 +83,11 @@ class Put : public Txn {
     COMMIT;
   }
 
+  // Writes do not depend on any reads, so there is never anything to redo.
+  virtual void Heal(const KeySet& stale) { COMMIT; }
+
+  virtual bool NeverAborts() const { return true; }
+
  private:
   map<Key, Value> m_;
 };
@@ -80,12 +97,12 @@ class RMW : public Txn {
  public:
   explicit RMW(double time = 0) : time_(time) {}
   RMW(const set<Key>& writeset, double time = 0) : time_(time) {
-    writeset_ = writeset;
+    writeset_.insert(writeset.begin(), writeset.end());
   }
   RMW(const set<Key>& readset, const set<Key>& writeset, double time = 0)
       : time_(time) {
-    readset_ = readset;
-    writeset_ = writeset;
+    readset_.insert(readset.begin(), readset.end());
+    writeset_.insert(writeset.begin(), writeset.end());
   }
 
   // Constructor with randomized read/write sets
@@ -120,13 +137,14 @@ class RMW : public Txn {
   }
 
   virtual void Run() {
+    TXN_BEGIN;
     Value result;
     // Read everything in readset.
-    for (set<Key>::iterator it = readset_.begin(); it != readset_.end(); ++it)
+    for (KeySet::iterator it = readset_.begin(); it != readset_.end(); ++it)
       Read(*it, &result);
 
     // Increment length of everything in writeset.
-    for (set<Key>::iterator it = writeset_.begin(); it != writeset_.end();
+    for (KeySet::iterator it = writeset_.begin(); it != writeset_.end();
          ++it) {
       result = 0;
       Read(*it, &result);
@@ -134,11 +152,128 @@ class RMW : public Txn {
     }
 
     // Wait a random amount of time (averaging time_) before committing.
-    Sleep(0.9 * time_ + RandomDouble(time_ * 0.2));
+    WAIT(0.9 * time_ + RandomDouble(time_ * 0.2));
     COMMIT;
+    TXN_END;
+  }
+
+  virtual void Heal(const KeySet& stale) {
+    // Only the increments of stale keys in the writeset depend on the values
+    // read; the reads of the readset and the simulated work are not redone.
+    Value result;
+    for (KeySet::iterator it = stale.begin(); it != stale.end(); ++it) {
+      if (writeset_.count(*it)) {
+        result = 0;
+        Read(*it, &result);
+        Write(*it, result + 1);
+      }
+    }
+    COMMIT;
+  }
+
+  virtual bool NeverAborts() const { return true; }
+
+ private:
+  double time_;
+};
+
+// Dependent read-modify-write transaction: reads the key stored in record
+// 'pointer', and increments the record it points to (like an update through
+// a secondary index). Its writeset is only known after reconnaissance.
+class Indirect : public Txn {
+ public:
+  explicit Indirect(Key pointer, double time = 0)
+      : pointer_(pointer), time_(time) {
+    reconset_.insert(pointer);
   }
 
+  Indirect* clone() const {             // Virtual constructor (copying)
+    Indirect* clone = new Indirect(pointer_, time_);
+    this->CopyTxnInternals(clone);
+    return clone;
+  }
+
+  virtual void Recon() {
+    Value target;
+    readset_.insert(pointer_);
+    if (Read(pointer_, &target))
+      writeset_.insert(target);
+  }
+
+  virtual void Run() {
+    TXN_BEGIN;
+    {
+      Value target, result = 0;
+      if (!Read(pointer_, &target)) {
+        ABORT;
+      }
+      Read(target, &result);
+      Write(target, result + 1);
+    }
+
+    // Wait a random amount of time (averaging time_) before committing.
+    WAIT(0.9 * time_ + RandomDouble(time_ * 0.2));
+    COMMIT;
+    TXN_END;
+  }
+
+ private:
+  Key pointer_;
+  double time_;
+};
+
+// Counter update transaction: blindly adds 'delta' to every key in its delta
+// set.
+class Bump : public Txn {
+ public:
+  Bump(const set<Key>& deltaset, int64 delta = 1, double time = 0)
+      : delta_(delta), time_(time) {
+    deltaset_.insert(deltaset.begin(), deltaset.end());
+  }
+
+  // Constructor with randomized delta set
+  Bump(int dbsize, int deltasetsize, double time = 0)
+      : delta_(1), time_(time) {
+    // Make sure we can find enough unique keys.
+    DCHECK(dbsize >= deltasetsize);
+
+    // Find deltasetsize unique keys.
+    for (int i = 0; i < deltasetsize; i++) {
+      Key key;
+      do {
+        key = rand() % dbsize;
+      } while (deltaset_.count(key));
+      deltaset_.insert(key);
+    }
+  }
+
+  Bump* clone() const {             // Virtual constructor (copying)
+    Bump* clone = new Bump(set<Key>(), delta_, time_);
+    this->CopyTxnInternals(clone);
+    return clone;
+  }
+
+  virtual void Run() {
+    TXN_BEGIN;
+    // Increment everything in the delta set.
+    for (KeySet::iterator it = deltaset_.begin(); it != deltaset_.end();
+         ++it) {
+      Increment(*it, delta_);
+    }
+
+    // Wait a random amount of time (averaging time_) before committing.
+    WAIT(0.9 * time_ + RandomDouble(time_ * 0.2));
+    COMMIT;
+    TXN_END;
+  }
+
+  // Nothing is read, so there is never anything to redo.
+  virtual void Heal(const KeySet& stale) { COMMIT; }
+
+  virtual bool NeverAborts() const { return true; }
+
  private:
+  int64 delta_;
   double time_;
 };
 
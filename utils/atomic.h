@@ -32,6 +32,7 @@
 #include <queue>
 #include <tr1/unordered_map>
 #include <set>
+#include <vector>
 
 #include <assert.h>
 #include "utils/mutex.h"
@@ -39,6 +40,7 @@
 using std::queue;
 using std::set;
 using std::tr1::unordered_map;
+using std::vector;
 
 /// @class AtomicMap<K, V>
 ///
@@ -199,6 +201,28 @@ class AtomicQueue {
     }
   }
 
+  // Atomically pushes all of 'items' onto the queue, in order.
+  void PushBatch(const vector<T>& items) {
+    mutex_.Lock();
+    for (typename vector<T>::const_iterator it = items.begin();
+         it != items.end(); ++it)
+      queue_.push(*it);
+    mutex_.Unlock();
+  }
+
+  // Atomically pops all elements from the queue, appending them to
+  // '*result' in order. Returns the number of elements popped.
+  int PopAll(vector<T>* result) {
+    mutex_.Lock();
+    int count = queue_.size();
+    while (!queue_.empty()) {
+      result->push_back(queue_.front());
+      queue_.pop();
+    }
+    mutex_.Unlock();
+    return count;
+  }
+
   // If mutex is immediately acquired, pushes and returns true, else immediately
   // returns false.
   bool PushNonBlocking(const T& item) {
@@ -0,0 +1,105 @@
+/// @file
+///
+/// Futex-based primitives for parking threads until another thread has
+/// something for them, without holding a mutex or polling.
+
+#ifndef _DB_UTILS_EVENTCOUNT_H_
+#define _DB_UTILS_EVENTCOUNT_H_
+
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/// Puts the calling thread to sleep as long as '*addr' equals 'val', for at
+/// most '*timeout' (forever if 'timeout' is NULL). May return spuriously.
+inline void FutexWait(volatile int* addr, int val,
+                      const struct timespec* timeout) {
+  syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, timeout, NULL, 0);
+}
+
+inline void FutexWait(volatile int* addr, int val) {
+  FutexWait(addr, val, NULL);
+}
+
+/// Wakes up to 'count' threads sleeping in 'FutexWait(addr, ...)'.
+inline void FutexWake(volatile int* addr, int count) {
+  syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+/// @class EventCount
+///
+/// Lets consumers of a lock-free or separately locked data structure sleep
+/// until a producer signals that there may be new data. To wait for a
+/// condition:
+///
+///    while (!condition) {
+///      int key = ec.PrepareWait();
+///      if (condition) {
+///        ec.CancelWait();
+///        break;
+///      }
+///      ec.Wait(key);
+///    }
+///
+/// Producers make the condition true and then call 'Notify()'. Notifying is a
+/// single atomic increment unless some thread is waiting.
+class EventCount {
+ public:
+  EventCount() : epoch_(0), waiters_(0) {}
+
+  /// Announces that the calling thread is about to wait. The caller must
+  /// re-check its condition before calling 'Wait()' with the returned key, or
+  /// call 'CancelWait()' instead.
+  inline int PrepareWait() {
+    __sync_fetch_and_add(&waiters_, 1);
+    return epoch_;
+  }
+
+  /// Withdraws an announcement made by 'PrepareWait()'.
+  inline void CancelWait() {
+    __sync_fetch_and_sub(&waiters_, 1);
+  }
+
+  /// Sleeps until a 'Notify()' issued after the 'PrepareWait()' that returned
+  /// 'key'. May return spuriously.
+  inline void Wait(int key) {
+    while (epoch_ == key)
+      FutexWait(&epoch_, key);
+    __sync_fetch_and_sub(&waiters_, 1);
+  }
+
+  /// Like 'Wait()', but returns after at most 'timeout' seconds.
+  inline void WaitFor(int key, double timeout) {
+    struct timespec ts;
+    ts.tv_sec = static_cast<time_t>(timeout);
+    ts.tv_nsec = static_cast<long>((timeout - ts.tv_sec) * 1e9);  // NOLINT
+    if (epoch_ == key)
+      FutexWait(&epoch_, key, &ts);
+    __sync_fetch_and_sub(&waiters_, 1);
+  }
+
+  /// Wakes one waiting thread, if any.
+  inline void Notify() {
+    __sync_fetch_and_add(&epoch_, 1);
+    if (waiters_ != 0)
+      FutexWake(&epoch_, 1);
+  }
+
+  /// Wakes all waiting threads.
+  inline void NotifyAll() {
+    __sync_fetch_and_add(&epoch_, 1);
+    if (waiters_ != 0)
+      FutexWake(&epoch_, INT_MAX);
+  }
+
+ private:
+  // Incremented by every notification.
+  volatile int epoch_;
+
+  // Number of threads between 'PrepareWait()' and the end of 'Wait()'.
+  volatile int waiters_;
+};
+
+#endif  // _DB_UTILS_EVENTCOUNT_H_
@@ -0,0 +1,273 @@
+/// @file
+///
+/// Sorted-array set and map for small collections, such as the records
+/// accessed by a txn. Up to N elements are stored inside the container
+/// itself, so small collections need no heap allocation at all; larger ones
+/// move to a heap array that grows by doubling. With N = 0, the container
+/// only takes the space of a pointer and two counts while it is empty.
+/// Containers of the same element type share iterator types, whatever their
+/// N. Lookups are binary searches
+/// and iteration is a linear scan of contiguous memory. Inserts and erases
+/// shift the elements behind them, which is cheap at the intended sizes.
+///
+/// Unlike their std:: counterparts, FlatSet and FlatMap invalidate all
+/// iterators and pointers to elements on every insert or erase.
+
+#ifndef _DB_UTILS_FLAT_SET_H_
+#define _DB_UTILS_FLAT_SET_H_
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <utility>
+
+using std::pair;
+
+/// @class FlatArray<T, N>
+///
+/// Storage shared by FlatSet and FlatMap: an array of elements, inline while
+/// there are at most N of them.
+template<typename T, int N>
+class FlatArray {
+ public:
+  FlatArray() : data_(inline_), size_(0), capacity_(N) {}
+
+  FlatArray(const FlatArray& other)
+      : data_(inline_), size_(0), capacity_(N) {
+    Assign(other);
+  }
+
+  ~FlatArray() {
+    if (data_ != inline_)
+      delete[] data_;
+  }
+
+  FlatArray& operator=(const FlatArray& other) {
+    if (this != &other)
+      Assign(other);
+    return *this;
+  }
+
+  // Returns the number of elements.
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Removes all elements. Keeps any heap array for reuse.
+  void clear() { size_ = 0; }
+
+  // Makes room for at least 'capacity' elements, so that no insert needs to
+  // grow the array until there are more.
+  void reserve(size_t capacity) { Reserve(capacity); }
+
+  // Exchanges the contents of two containers. Constant time unless either
+  // one holds its elements inline.
+  void swap(FlatArray& other) {
+    if (data_ != inline_ && other.data_ != other.inline_) {
+      std::swap(data_, other.data_);
+      std::swap(size_, other.size_);
+      std::swap(capacity_, other.capacity_);
+    } else {
+      FlatArray tmp(*this);
+      *this = other;
+      other = tmp;
+    }
+  }
+
+ protected:
+  // Replaces the elements with copies of those of 'other'.
+  void Assign(const FlatArray& other) {
+    Reserve(other.size_);
+    std::copy(other.data_, other.data_ + other.size_, data_);
+    size_ = other.size_;
+  }
+
+  // Inserts 'value' at position 'i', shifting the elements behind it.
+  void InsertAt(size_t i, const T& value) {
+    if (size_ == capacity_)
+      Reserve(capacity_ == 0 ? kMinHeapCapacity : 2 * capacity_);
+    std::copy_backward(data_ + i, data_ + size_, data_ + size_ + 1);
+    data_[i] = value;
+    size_++;
+  }
+
+  // Removes the element at position 'i', shifting the elements behind it.
+  void EraseAt(size_t i) {
+    std::copy(data_ + i + 1, data_ + size_, data_ + i);
+    size_--;
+  }
+
+  // Makes room for at least 'capacity' elements.
+  void Reserve(size_t capacity) {
+    if (capacity <= capacity_)
+      return;
+    T* data = new T[capacity];
+    std::copy(data_, data_ + size_, data);
+    if (data_ != inline_)
+      delete[] data_;
+    data_ = data;
+    capacity_ = capacity;
+  }
+
+  // Initial size of the heap array of a container with no inline elements.
+  static const size_t kMinHeapCapacity = 4;
+
+  // Elements, in increasing order. Points to 'inline_' or to a heap array.
+  // (Arrays cannot be empty, so 'inline_' has room for one element even if
+  // N is 0, but that element is never used.)
+  T* data_;
+  size_t size_;
+  size_t capacity_;
+  T inline_[N > 0 ? N : 1];
+};
+
+/// @class FlatSet<T, N>
+///
+/// Set of elements of type T, with the interface of std::set (less the parts
+/// that rely on stable iterators).
+template<typename T, int N>
+class FlatSet : public FlatArray<T, N> {
+ public:
+  typedef const T* iterator;
+  typedef const T* const_iterator;
+
+  FlatSet() {}
+
+  // Constructs a set of the elements in ['first', 'last').
+  template<typename InputIterator>
+  FlatSet(InputIterator first, InputIterator last) {
+    insert(first, last);
+  }
+
+  iterator begin() const { return this->data_; }
+  iterator end() const { return this->data_ + this->size_; }
+
+  // Returns the position of the first element not less than 'value'.
+  iterator lower_bound(const T& value) const {
+    return std::lower_bound(begin(), end(), value);
+  }
+
+  // Returns the position of 'value', or 'end()' if it is not in the set.
+  iterator find(const T& value) const {
+    iterator it = lower_bound(value);
+    return (it != end() && !(value < *it)) ? it : end();
+  }
+
+  size_t count(const T& value) const { return find(value) != end(); }
+
+  // Adds 'value' unless the set already contains it. Returns its position
+  // and whether it was added.
+  pair<iterator, bool> insert(const T& value) {
+    // Sets are mostly built in increasing order, so try appending first.
+    size_t i = this->size_;
+    if (i != 0 && !(this->data_[i - 1] < value)) {
+      i = lower_bound(value) - begin();
+      if (!(value < this->data_[i]))
+        return pair<iterator, bool>(begin() + i, false);
+    }
+    this->InsertAt(i, value);
+    return pair<iterator, bool>(begin() + i, true);
+  }
+
+  // Adds all elements in ['first', 'last').
+  template<typename InputIterator>
+  void insert(InputIterator first, InputIterator last) {
+    for (; first != last; ++first)
+      insert(*first);
+  }
+
+  // Removes 'value', if present. Returns the number of elements removed.
+  size_t erase(const T& value) {
+    iterator it = find(value);
+    if (it == end())
+      return 0;
+    this->EraseAt(it - begin());
+    return 1;
+  }
+
+  bool operator==(const FlatSet& other) const {
+    return this->size_ == other.size_ &&
+           std::equal(begin(), end(), other.begin());
+  }
+  bool operator!=(const FlatSet& other) const { return !(*this == other); }
+};
+
+/// @class FlatMap<K, V, N>
+///
+/// Map from keys of type K to values of type V, with the interface of
+/// std::map (less the parts that rely on stable iterators). Elements are
+/// pair<K, V>, whose keys must not be modified through an iterator.
+template<typename K, typename V, int N>
+class FlatMap : public FlatArray<pair<K, V>, N> {
+ public:
+  typedef pair<K, V> value_type;
+  typedef value_type* iterator;
+  typedef const value_type* const_iterator;
+
+  FlatMap() {}
+
+  iterator begin() { return this->data_; }
+  iterator end() { return this->data_ + this->size_; }
+  const_iterator begin() const { return this->data_; }
+  const_iterator end() const { return this->data_ + this->size_; }
+
+  // Returns the position of the first element whose key is not less than
+  // 'key'.
+  iterator lower_bound(const K& key) {
+    return begin() + LowerBound(key);
+  }
+  const_iterator lower_bound(const K& key) const {
+    return begin() + LowerBound(key);
+  }
+
+  // Returns the position of the element with key 'key', or 'end()' if there
+  // is none.
+  iterator find(const K& key) {
+    return begin() + Find(key);
+  }
+  const_iterator find(const K& key) const {
+    return begin() + Find(key);
+  }
+
+  size_t count(const K& key) const { return find(key) != end(); }
+
+  // Returns the value of key 'key', adding it (with value V()) if it is not
+  // in the map yet.
+  V& operator[](const K& key) {
+    size_t i = this->size_;
+    if (i != 0 && !(this->data_[i - 1].first < key)) {
+      i = LowerBound(key);
+      if (!(key < this->data_[i].first))
+        return this->data_[i].second;
+    }
+    this->InsertAt(i, value_type(key, V()));
+    return this->data_[i].second;
+  }
+
+  // Removes the element with key 'key', if present. Returns the number of
+  // elements removed.
+  size_t erase(const K& key) {
+    size_t i = Find(key);
+    if (i == this->size_)
+      return 0;
+    this->EraseAt(i);
+    return 1;
+  }
+
+ private:
+  static bool KeyLess(const value_type& element, const K& key) {
+    return element.first < key;
+  }
+
+  // Index versions of 'lower_bound()' and 'find()'.
+  size_t LowerBound(const K& key) const {
+    return std::lower_bound(this->data_, this->data_ + this->size_, key,
+                            KeyLess) - this->data_;
+  }
+  size_t Find(const K& key) const {
+    size_t i = LowerBound(key);
+    return (i != this->size_ && !(key < this->data_[i].first)) ? i
+                                                               : this->size_;
+  }
+};
+
+#endif  // _DB_UTILS_FLAT_SET_H_
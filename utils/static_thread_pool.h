@@ -5,19 +5,26 @@
 #define _DB_UTILS_STATIC_THREAD_POOL_H_
 
 #include "pthread.h"
+#include "sched.h"
 #include "stdlib.h"
 #include "assert.h"
 #include <queue>
 #include <string>
 #include <vector>
 #include "utils/atomic.h"
+#include "utils/eventcount.h"
+#include "utils/mutex.h"
 #include "utils/thread_pool.h"
 
 using std::queue;
 using std::string;
 using std::vector;
 
-//
+// Thread i of the pool is the home thread of queue i % nqueues, which it
+// serves first; other queues are only served by threads that would otherwise
+// be idle. If 'cpus' is not empty, thread i is also pinned to CPU
+// cpus[i % cpus.size()], so that one thread and one queue per CPU makes the
+// queues core-local.
 class StaticThreadPool : public ThreadPool {
  public:
   StaticThreadPool(int nthreads)
@@ -30,8 +37,33 @@ class StaticThreadPool : public ThreadPool {
     Start();
   }
 
+  StaticThreadPool(int nthreads, int nqueues, const vector<int>& cpus)
+      : thread_count_(nthreads), queue_count_(nqueues), cpus_(cpus),
+        stopped_(false) {
+    Start();
+  }
+
   ~StaticThreadPool() {
+    Stop();
+  }
+
+  // Stops all threads once their current task (if any) returns, and waits
+  // for them to exit. Subsequent calls have no effect.
+  void Stop() {
+    if (stopped_)
+      return;
     stopped_ = true;
+
+    // Dedicated threads may still add tasks until they notice, so wait for
+    // them before the pool's threads drain the queues.
+    dedicated_mutex_.Lock();
+    vector<pthread_t> dedicated;
+    dedicated.swap(dedicated_threads_);
+    dedicated_mutex_.Unlock();
+    for (size_t i = 0; i < dedicated.size(); i++)
+      pthread_join(dedicated[i], NULL);
+
+    work_.NotifyAll();
     for (int i = 0; i < thread_count_; i++)
       pthread_join(threads_[i], NULL);
   }
@@ -40,68 +72,191 @@ class StaticThreadPool : public ThreadPool {
 
   virtual void RunTask(Task* task) {
     assert(!stopped_);
-    while (!queues_[rand() % queue_count_].PushNonBlocking(task)) {}
+    while (!queues_[rand() % queue_count_].tasks_.PushNonBlocking(task)) {}
+    work_.Notify();
+  }
+
+  // Like 'RunTask()', but adds 'task' to queue 'queue' (modulo the number of
+  // queues), so that it preferably runs on that queue's home threads.
+  void RunTaskOn(int queue, Task* task) {
+    assert(!stopped_);
+    queues_[queue % queue_count_].tasks_.Push(task);
+    work_.Notify();
+  }
+
+  // Runs 'task' in a new thread of its own, outside the pool's threads and
+  // not pinned to any CPU. Meant for tasks that loop until 'Active()' turns
+  // false, which would otherwise take a pool thread (and its queue) away for
+  // good. 'Stop()' waits for the thread to exit. Once the pool is stopping,
+  // 'task' is deleted without being run.
+  void RunDedicatedTask(Task* task) {
+    dedicated_mutex_.Lock();
+    if (stopped_) {
+      dedicated_mutex_.Unlock();
+      delete task;
+      return;
+    }
+    pthread_t thread;
+    pthread_create(&thread, NULL, RunDedicatedThread,
+                   reinterpret_cast<void*>(task));
+    dedicated_threads_.push_back(thread);
+    dedicated_mutex_.Unlock();
+  }
+
+  // Like 'RunTask()', but 'task' is run ahead of tasks added by 'RunTask()'.
+  void RunUrgentTask(Task* task) {
+    assert(!stopped_);
+    urgent_.Push(task);
+    work_.Notify();
   }
 
   virtual int ThreadCount() { return thread_count_; }
 
+  int QueueCount() { return queue_count_; }
+
  private:
   void Start() {
     threads_.resize(thread_count_);
+    thread_args_.resize(thread_count_);
     queues_.resize(queue_count_);
     for (int i = 0; i < thread_count_; i++) {
+      thread_args_[i].tp_ = this;
+      thread_args_[i].index_ = i;
+
+      // Pin the thread before it starts, so that it never runs elsewhere.
+      pthread_attr_t attr;
+      pthread_attr_init(&attr);
+      if (!cpus_.empty()) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(cpus_[i % cpus_.size()], &cpuset);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpuset), &cpuset);
+      }
       pthread_create(&threads_[i],
-                     NULL,
+                     &attr,
                      RunThread,
-                     reinterpret_cast<void*>(this));
+                     reinterpret_cast<void*>(&thread_args_[i]));
+      pthread_attr_destroy(&attr);
     }
   }
 
+  // Function executed by each thread started by 'RunDedicatedTask()'.
+  static void* RunDedicatedThread(void* arg) {
+    Task* task = reinterpret_cast<Task*>(arg);
+    task->Run();
+    delete task;
+    return NULL;
+  }
+
   // Function executed by each pthread.
   static void* RunThread(void* arg) {
-    StaticThreadPool* tp = reinterpret_cast<StaticThreadPool*>(arg);
+    ThreadArg* thread_arg = reinterpret_cast<ThreadArg*>(arg);
+    StaticThreadPool* tp = thread_arg->tp_;
+    int home = thread_arg->index_ % tp->queue_count_;
     Task* task;
     int sleep_duration = 1;  // in microseconds
+    int urgent_run = 0;      // Urgent tasks run since the last other one
     while (true) {
-      if (tp->queues_[rand() % tp->queue_count_].PopNonBlocking(&task)) {
+      // Run urgent tasks first, but no more than kUrgentBurst of them in a
+      // row while other tasks are waiting, so that those cannot starve. Then
+      // prefer the home queue over the others.
+      bool found_task = false;
+      if (urgent_run < kUrgentBurst && tp->urgent_.PopNonBlocking(&task)) {
+        urgent_run++;
+        found_task = true;
+      } else if (tp->queues_[home].tasks_.PopNonBlocking(&task) ||
+                 tp->queues_[rand() % tp->queue_count_].tasks_.PopNonBlocking(
+                     &task)) {
+        urgent_run = 0;
+        found_task = true;
+      } else if (tp->urgent_.PopNonBlocking(&task)) {
+        found_task = true;
+      }
+
+      if (found_task) {
         task->Run();
         delete task;
         // Reset backoff.
         sleep_duration = 1;
-      } else {
+      } else if (sleep_duration < 32) {
         usleep(sleep_duration);
         // Back off exponentially.
-        if (sleep_duration < 32)
-          sleep_duration *= 2;
+        sleep_duration *= 2;
+      } else {
+        // Still nothing to do. Sleep until a task is added.
+        int key = tp->work_.PrepareWait();
+        if (tp->stopped_ || tp->HasTasks())
+          tp->work_.CancelWait();
+        else
+          tp->work_.Wait(key);
       }
 
       if (tp->stopped_) {
         // Go through ALL queues looking for a remaining task.
-        bool found_task = false;
+        found_task = tp->urgent_.Pop(&task);
         int start = rand() % tp->queue_count_;
-        for (int i = 0; i < tp->queue_count_; i++) {
-          if (tp->queues_[(start + i) % tp->queue_count_].Pop(&task)) {
+        for (int i = 0; !found_task && i < tp->queue_count_; i++) {
+          if (tp->queues_[(start + i) % tp->queue_count_].tasks_.Pop(&task))
             found_task = true;
-            task->Run();
-            delete task;
-            break;
-          }
         }
         if (!found_task) {
           // All queues are empty.
           break;
         }
+        task->Run();
+        delete task;
       }
     }
     return NULL;
   }
 
+  // Returns true if any queue holds a task.
+  bool HasTasks() {
+    if (urgent_.Size() != 0)
+      return true;
+    for (int i = 0; i < queue_count_; i++) {
+      if (queues_[i].tasks_.Size() != 0)
+        return true;
+    }
+    return false;
+  }
+
+  // Task queue, padded so that no two queues share a cache line.
+  struct PaddedQueue {
+    AtomicQueue<Task*> tasks_;
+    char padding_[64];
+  };
+
+  // Argument passed to 'RunThread()': the pool, and the index of the thread
+  // (which determines its home queue and CPU).
+  struct ThreadArg {
+    StaticThreadPool* tp_;
+    int index_;
+  };
+
   int thread_count_;
   vector<pthread_t> threads_;
+  vector<ThreadArg> thread_args_;
 
   // Task queues.
   int queue_count_;
-  vector<AtomicQueue<Task*> > queues_;
+  vector<PaddedQueue> queues_;
+
+  // CPUs the threads are pinned to (none if empty).
+  vector<int> cpus_;
+
+  // Threads started by 'RunDedicatedTask()'.
+  vector<pthread_t> dedicated_threads_;
+  Mutex dedicated_mutex_;
+
+  // Queue of tasks added by 'RunUrgentTask()', shared by all threads.
+  AtomicQueue<Task*> urgent_;
+
+  // Maximum number of urgent tasks a thread runs in a row.
+  static const int kUrgentBurst = 8;
+
+  // Notified whenever a task is added, so that idle threads can sleep.
+  EventCount work_;
 
   bool stopped_;
 };